@@ -12,6 +12,8 @@ layout(location = 1) in vec2 i_tex_coords;
 layout(location = 2) in vec3 i_normal;
 // @Todo I want this to a uniform here, together with model id
 layout(location = 3) in vec3 i_view_pos;
+// every model is drawn by the same indirect call, the instance says which one this is
+layout(location = 4) flat in uint i_model_index;
 
 layout(location = 0) out vec4 o_color;
 
@@ -20,11 +22,19 @@ layout(location = 0) out vec4 o_color;
 #extension GL_EXT_buffer_reference : enable
 #extension GL_EXT_nonuniform_qualifier : enable
 
+// texture slots, -1 if the material has no such map
+#define TEXTURE_ALBEDO    0
+#define TEXTURE_ROUGHNESS 1
+#define TEXTURE_METALLIC  2
+#define TEXTURE_NORMAL    3
+
 struct Material {
     vec4 albedo;
     float metallic;
     float specular;
     float roughness;
+    float _pad;
+    ivec4 textures;
 };
 
 struct ModelDescription {
@@ -35,11 +45,13 @@ layout(std140, set=0, binding=1) readonly buffer MaterialsBuffer {
 	Material materials[];
 } materialsBuffer;
 
-layout(std140, set=0, binding=2) readonly buffer ModelDescriptionsBuffer {
+// std430, std140 would pad every description to 16 bytes
+layout(std430, set=0, binding=2) readonly buffer ModelDescriptionsBuffer {
     ModelDescription descriptions[];
 } modelDescriptionsBuffer;
 
-layout(binding = 3) uniform sampler2D[] textureSamplers;
+// bindless, sized by the number of loaded textures
+layout(set = 1, binding = 0) uniform sampler2D textureSamplers[];
 
 layout(buffer_reference, scalar) buffer MaterialIndices {int i[]; }; 
 
@@ -81,10 +93,30 @@ float geometry_smith(vec3 N, vec3 wo, vec3 wi, float roughness) {
     return ggx1 * ggx2;
 }
 
+// normal mapping without tangents, the tangent frame is built from screen space derivatives
+// http://www.thetenthplanet.de/archives/1180
+vec3 perturb_normal(vec3 N, vec3 p, vec2 uv, vec3 map) {
+    vec3 dp1  = dFdx(p);
+    vec3 dp2  = dFdy(p);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+
+    float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
+    mat3 TBN = mat3(T * invmax, B * invmax, N);
+
+    return normalize(TBN * (map * 2.0 - 1.0));
+}
+
 void main() {
-    ModelDescription description     = modelDescriptionsBuffer.descriptions[0];
+    ModelDescription description     = modelDescriptionsBuffer.descriptions[i_model_index];
     MaterialIndices material_indices = MaterialIndices(description.material_indices_address);
 
+    // the primitive id restarts for every draw command and instance, so it indexes the model's own range
     int mat_index = material_indices.i[gl_PrimitiveID];
     Material m    = materialsBuffer.materials[mat_index];
 
@@ -96,7 +128,23 @@ void main() {
     float specular  = m.specular;
     float roughness = m.roughness;
 
+    if (m.textures[TEXTURE_ALBEDO] >= 0) {
+        albedo *= texture(textureSamplers[nonuniformEXT(m.textures[TEXTURE_ALBEDO])], i_tex_coords).rgb;
+    }
+    if (m.textures[TEXTURE_ROUGHNESS] >= 0) {
+        roughness = texture(textureSamplers[nonuniformEXT(m.textures[TEXTURE_ROUGHNESS])], i_tex_coords).r;
+    }
+    if (m.textures[TEXTURE_METALLIC] >= 0) {
+        metallic = texture(textureSamplers[nonuniformEXT(m.textures[TEXTURE_METALLIC])], i_tex_coords).r;
+    }
+
     vec3 N  = normalize(i_normal);
+    if (m.textures[TEXTURE_NORMAL] >= 0) {
+        // BC5 only stores xy, so z is always reconstructed
+        vec2 xy  = texture(textureSamplers[nonuniformEXT(m.textures[TEXTURE_NORMAL])], i_tex_coords).rg * 2.0 - 1.0;
+        vec3 map = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0))) * 0.5 + 0.5;
+        N = perturb_normal(N, i_frag_pos, i_tex_coords, map);
+    }
     vec3 wi = normalize(light_pos - i_frag_pos);
     vec3 wo = normalize(i_view_pos - i_frag_pos);
     vec3 H  = normalize(wo + wi);
@@ -8,6 +8,7 @@ layout(location = 0) out vec3 o_frag_pos;
 layout(location = 1) out vec2 o_tex_coords;
 layout(location = 2) out vec3 o_normal;
 layout(location = 3) out vec3 o_view_pos;
+layout(location = 4) flat out uint o_model_index;
 
 layout(binding = 0) uniform globals {
 	mat4 proj_matrix;
@@ -15,18 +16,31 @@ layout(binding = 0) uniform globals {
     vec3 view_pos;
 };
 
+// the normal matrix is the inverse transpose of the model matrix, computed on the cpu
+struct Instance {
+    mat4 model_matrix;
+    mat4 normal_matrix;
+    uint model_index;
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer InstancesBuffer {
+    Instance instances[];
+};
+
 out gl_PerVertex {
 	vec4 gl_Position;
 };
 
 void main() {
-    mat4 model_matrix = mat4(1.0);
-    vec4 world_pos = model_matrix * vec4(i_position, 1.0);
+    // gl_InstanceIndex already includes the draw's first instance
+    Instance instance = instances[gl_InstanceIndex];
+    vec4 world_pos = instance.model_matrix * vec4(i_position, 1.0);
 
 	gl_Position = proj_matrix * view_matrix * world_pos;
 
     o_frag_pos = world_pos.xyz; 
-    o_normal = mat3(transpose(inverse(model_matrix))) * i_normal;
+    o_normal = mat3(instance.normal_matrix) * i_normal;
 	o_tex_coords = i_tex_coords;
     o_view_pos = view_pos;
+    o_model_index = instance.model_index;
 }
@@ -50,8 +50,16 @@ project "pbr"
 		"src/base/**.c",
 	}
 
+	-- every platform only compiles its own os layer
 	filter { "system:windows" }
     files { "src/base/win/*.c" }
+    removefiles { "src/base/linux/**" }
+
+	filter { "system:linux" }
+    files { "src/base/linux/*.c" }
+    removefiles { "src/base/win/**" }
+
+	filter {}
 
   includedirs
   {
@@ -76,6 +84,9 @@ project "pbr"
 		libdirs { "%{VULKAN_SDK}/Lib"}
 		systemversion "latest"
 
+	filter { "system:linux" }
+		links { "vulkan", "pthread", "dl" }
+
     filter { "system:macosx" }
       defines { "GL_SILENCE_DEPRECATION" }
       linkoptions { "-framework OpenGL -framework Cocoa -framework IOKit" }
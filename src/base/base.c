@@ -31,3 +31,15 @@ log_dev(const char *fmt, ...)
     putc('\n', stdout);
     va_end(args);
 }
+
+U64
+hash_fnv1a(const void *data, U64 size)
+{
+    const U8 *bytes = (const U8 *)data;
+    U64       hash  = 14695981039346656037ull;
+    for (U64 i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
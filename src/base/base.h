@@ -28,6 +28,30 @@ typedef int32_t  B32;
 #define read_only const
 #endif
 
+#if COMPILER_MSVC
+#define thread_static __declspec(thread)
+#elif COMPILER_CLANG || COMPILER_GCC
+#define thread_static __thread
+#endif
+
+// sequentially consistent, for counters and flags shared between threads
+#if COMPILER_MSVC
+#include <intrin.h>
+#define atomic_u32_eval(x)           ((U32)_InterlockedOr((volatile long *)(x), 0))
+#define atomic_u32_inc_eval(x)       ((U32)_InterlockedIncrement((volatile long *)(x)))
+#define atomic_u32_eval_assign(x, c) ((U32)_InterlockedExchange((volatile long *)(x), (long)(c)))
+#elif COMPILER_CLANG || COMPILER_GCC
+#define atomic_u32_eval(x)           __atomic_load_n((x), __ATOMIC_SEQ_CST)
+#define atomic_u32_inc_eval(x)       __atomic_add_fetch((x), 1, __ATOMIC_SEQ_CST)
+#define atomic_u32_eval_assign(x, c) __atomic_exchange_n((x), (c), __ATOMIC_SEQ_CST)
+#endif
+
+#if LANG_CPP
+#define AlignOf(T) alignof(T)
+#else
+#define AlignOf(T) _Alignof(T)
+#endif
+
 #if LANG_CPP
 #define C_LINKAGE_BEGIN extern "C" {
 #define C_LINKAGE_END   }
@@ -168,4 +192,6 @@ C_LINKAGE_BEGIN
 void log_fatal(const char *fmt, ...);
 void log_dev(const char *fmt, ...);
 
+U64 hash_fnv1a(const void *data, U64 size);
+
 C_LINKAGE_END
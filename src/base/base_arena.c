@@ -0,0 +1,118 @@
+#include "base_arena.h"
+
+#include <string.h>
+
+thread_static Arena *g_scratch_arenas[ARENA_SCRATCH_COUNT];
+
+Arena *
+arena_alloc(U64 reserve_size)
+{
+    reserve_size = AlignPow2(Max(reserve_size, ARENA_COMMIT_SIZE), ARENA_COMMIT_SIZE);
+
+    void *memory = os_reserve(reserve_size);
+    if (!memory || !os_commit(memory, ARENA_COMMIT_SIZE)) {
+        log_fatal("Failed to reserve arena of %llu bytes!", (unsigned long long)reserve_size);
+    }
+
+    Arena *arena     = (Arena *)memory;
+    arena->pos       = ARENA_HEADER_SIZE;
+    arena->committed = ARENA_COMMIT_SIZE;
+    arena->reserved  = reserve_size;
+
+    return arena;
+}
+
+void
+arena_release(Arena *arena)
+{
+    os_release(arena, arena->reserved);
+}
+
+void *
+arena_push_no_zero(Arena *arena, U64 size, U64 align)
+{
+    U64 pos     = AlignPow2(arena->pos, align);
+    U64 new_pos = pos + size;
+
+    if (new_pos > arena->reserved) {
+        log_fatal("Arena out of memory: %llu of %llu bytes requested", (unsigned long long)new_pos, (unsigned long long)arena->reserved);
+    }
+
+    if (new_pos > arena->committed) {
+        U64 new_committed = Min(AlignPow2(new_pos, ARENA_COMMIT_SIZE), arena->reserved);
+        if (!os_commit((U8 *)arena + arena->committed, new_committed - arena->committed)) {
+            log_fatal("Failed to commit arena memory!");
+        }
+        arena->committed = new_committed;
+    }
+
+    arena->pos = new_pos;
+
+    return (U8 *)arena + pos;
+}
+
+void *
+arena_push(Arena *arena, U64 size, U64 align)
+{
+    void *result = arena_push_no_zero(arena, size, align);
+    MemoryZero(result, size);
+    return result;
+}
+
+U64
+arena_pos(Arena *arena)
+{
+    return arena->pos;
+}
+
+void
+arena_pop_to(Arena *arena, U64 pos)
+{
+    arena->pos = Clamp(ARENA_HEADER_SIZE, pos, arena->pos);
+}
+
+void
+arena_clear(Arena *arena)
+{
+    arena_pop_to(arena, ARENA_HEADER_SIZE);
+}
+
+Temp
+temp_begin(Arena *arena)
+{
+    Temp temp  = {0};
+    temp.arena = arena;
+    temp.pos   = arena->pos;
+    return temp;
+}
+
+void
+temp_end(Temp temp)
+{
+    arena_pop_to(temp.arena, temp.pos);
+}
+
+Temp
+scratch_begin(Arena **conflicts, U64 conflict_count)
+{
+    for (U32 i = 0; i < ARENA_SCRATCH_COUNT; i++) {
+        if (!g_scratch_arenas[i]) {
+            g_scratch_arenas[i] = arena_alloc(ARENA_SCRATCH_RESERVE_SIZE);
+        }
+
+        B32 conflicting = 0;
+        for (U64 j = 0; j < conflict_count; j++) {
+            if (conflicts[j] == g_scratch_arenas[i]) {
+                conflicting = 1;
+                break;
+            }
+        }
+
+        if (!conflicting) {
+            return temp_begin(g_scratch_arenas[i]);
+        }
+    }
+
+    log_fatal("No free scratch arena!");
+    return (Temp){0};
+}
@@ -3,4 +3,49 @@
 #include "base.h"
 #include "base_os.h"
 
+C_LINKAGE_BEGIN
 
+// Linear allocator on top of a virtual memory reservation, pages are committed on demand as the arena grows.
+// The Arena header lives at the start of its own reservation.
+
+#define ARENA_HEADER_SIZE          64
+#define ARENA_COMMIT_SIZE          KB(64)
+#define ARENA_DEFAULT_RESERVE_SIZE MB(64)
+#define ARENA_SCRATCH_RESERVE_SIZE GB(8)
+#define ARENA_SCRATCH_COUNT        2
+
+typedef struct Arena Arena;
+typedef struct Temp  Temp;
+
+struct Arena {
+  U64 pos;
+  U64 committed;
+  U64 reserved;
+};
+
+struct Temp {
+  Arena *arena;
+  U64    pos;
+};
+
+Arena *arena_alloc(U64 reserve_size);
+void   arena_release(Arena *arena);
+
+void *arena_push_no_zero(Arena *arena, U64 size, U64 align);
+void *arena_push(Arena *arena, U64 size, U64 align);
+U64   arena_pos(Arena *arena);
+void  arena_pop_to(Arena *arena, U64 pos);
+void  arena_clear(Arena *arena);
+
+Temp temp_begin(Arena *arena);
+void temp_end(Temp temp);
+
+// Per thread scratch arenas, pass the arenas that are already in use by the caller as conflicts
+// so a nested scratch never hands out memory that is still alive further up the stack
+Temp scratch_begin(Arena **conflicts, U64 conflict_count);
+#define scratch_end(temp) temp_end(temp)
+
+#define push_array_no_zero(arena, T, count) (T *)arena_push_no_zero((arena), sizeof(T) * (count), Max(8, AlignOf(T)))
+#define push_array(arena, T, count)         (T *)arena_push((arena), sizeof(T) * (count), Max(8, AlignOf(T)))
+
+C_LINKAGE_END
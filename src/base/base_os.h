@@ -4,9 +4,42 @@
 
 C_LINKAGE_BEGIN
 
+typedef struct FileProperties FileProperties;
+typedef struct FileMap        FileMap;
+typedef struct Thread         Thread;
+
+typedef void ThreadFunction(void *param);
+
+struct FileProperties {
+  B32 exists;
+  U64 size;
+  U64 modified; // opaque timestamp, only meant to be compared for equality
+};
+
+struct FileMap {
+  void *data;
+  U64   size;
+  void *handles[2];
+};
+
+struct Thread {
+  void *handle;
+};
+
 void *os_reserve(U64 size);
 B32   os_commit(void *ptr, U64 size);
 void  os_decommit(void *ptr, U64 size);
 void  os_release(void *ptr, U64 size);
 
+FileProperties os_file_properties(const char *path);
+B32            os_file_map(FileMap *map, const char *path);
+void           os_file_unmap(FileMap *map);
+
+U64  os_now_microseconds(void);
+void os_sleep_milliseconds(U32 milliseconds);
+
+U32    os_processor_count(void);
+Thread os_thread_launch(ThreadFunction *func, void *param);
+void   os_thread_join(Thread thread);
+
 C_LINKAGE_END
@@ -0,0 +1,167 @@
+#include "base_profile.h"
+#include "base_arena.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if ARCH_X64 && COMPILER_MSVC
+#include <intrin.h>
+#elif ARCH_X64
+#include <x86intrin.h>
+#endif
+
+static B32            g_profile_enabled;
+static U64            g_profile_frame;
+static U64            g_profile_anchor_ticks;
+static U64            g_profile_anchor_us;
+static U32            g_profile_thread_count;
+static ProfileThread *g_profile_threads[PROFILE_THREAD_MAX];
+
+thread_static ProfileThread *t_profile_thread;
+
+static U64
+profile_ticks(void)
+{
+#if ARCH_X64
+    return __rdtsc();
+#else
+    return os_now_microseconds();
+#endif
+}
+
+void
+profile_set_enabled(B32 enabled)
+{
+    // the anchor pairs cycles with wall clock time, export derives the cycle rate from it
+    if (enabled && !g_profile_anchor_us) {
+        g_profile_anchor_ticks = profile_ticks();
+        g_profile_anchor_us    = os_now_microseconds();
+    }
+
+    g_profile_enabled = enabled;
+}
+
+B32
+profile_enabled(void)
+{
+    return g_profile_enabled;
+}
+
+void
+profile_frame_mark(U64 frame)
+{
+    g_profile_frame = frame;
+}
+
+ProfileZone
+profile_zone_begin(const char *name)
+{
+    ProfileZone zone = {0};
+
+    if (g_profile_enabled) {
+        zone.name  = name;
+        zone.begin = profile_ticks();
+    }
+
+    return zone;
+}
+
+static ProfileThread *
+profile_thread_get(void)
+{
+    if (!t_profile_thread) {
+        U32 id = atomic_u32_inc_eval(&g_profile_thread_count) - 1;
+        if (id >= PROFILE_THREAD_MAX) {
+            return 0;
+        }
+
+        // one reservation per thread, never released so the export can still read threads that already exited
+        Arena *arena = arena_alloc(sizeof(ProfileThread) + ARENA_HEADER_SIZE);
+
+        t_profile_thread     = push_array(arena, ProfileThread, 1);
+        t_profile_thread->id = id;
+
+        g_profile_threads[id] = t_profile_thread;
+    }
+
+    return t_profile_thread;
+}
+
+void
+profile_zone_end(ProfileZone *zone)
+{
+    if (!zone->name) {
+        return;
+    }
+
+    ProfileThread *thread = profile_thread_get();
+    if (!thread) {
+        return;
+    }
+
+    ProfileEvent *event = &thread->events[thread->event_count % PROFILE_RING_SIZE];
+    event->name         = zone->name;
+    event->begin        = zone->begin;
+    event->end          = profile_ticks();
+    event->frame        = g_profile_frame;
+
+    thread->event_count++;
+}
+
+B32
+profile_write_chrome_trace(const char *path, U64 first_frame, U64 last_frame)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        log_dev("Failed to write trace: %s", path);
+        return 0;
+    }
+
+    U64 now_ticks = profile_ticks();
+    U64 now_us    = os_now_microseconds();
+
+    F64 ticks_per_us = 1.0;
+    if (now_us > g_profile_anchor_us) {
+        ticks_per_us = (F64)(now_ticks - g_profile_anchor_ticks) / (F64)(now_us - g_profile_anchor_us);
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    B32 first       = 1;
+    U32 event_count = 0;
+
+    U32 thread_count = Min(g_profile_thread_count, PROFILE_THREAD_MAX);
+    for (U32 i = 0; i < thread_count; ++i) {
+        ProfileThread *thread = g_profile_threads[i];
+        if (!thread) {
+            continue;
+        }
+
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}", first ? "" : ",\n",
+                thread->id, thread->id);
+        first = 0;
+
+        U64 begin = thread->event_count > PROFILE_RING_SIZE ? thread->event_count - PROFILE_RING_SIZE : 0;
+        for (U64 j = begin; j < thread->event_count; ++j) {
+            ProfileEvent *event = &thread->events[j % PROFILE_RING_SIZE];
+            if (event->frame < first_frame || event->frame > last_frame) {
+                continue;
+            }
+
+            F64 ts  = (F64)(S64)(event->begin - g_profile_anchor_ticks) / ticks_per_us;
+            F64 dur = (F64)(event->end - event->begin) / ticks_per_us;
+
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                    event->name, thread->id, ts, dur, (unsigned long long)event->frame);
+            event_count++;
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    log_dev("Wrote %u trace events of frames %llu-%llu to %s", event_count, (unsigned long long)first_frame,
+            (unsigned long long)last_frame, path);
+
+    return 1;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "base.h"
+
+C_LINKAGE_BEGIN
+
+// Scoped CPU zones. Every thread records into its own ring of complete events, so recording takes no locks.
+// Timestamps are raw cycle counts (rdtsc on x64) and only converted to microseconds on export.
+// While profiling is disabled a zone costs one load and a branch.
+
+#define PROFILE_RING_SIZE  (1 << 16)
+#define PROFILE_THREAD_MAX 64
+
+typedef struct ProfileEvent  ProfileEvent;
+typedef struct ProfileThread ProfileThread;
+typedef struct ProfileZone   ProfileZone;
+
+struct ProfileEvent {
+  const char *name; // has to outlive the profiler, zones are named with string literals
+  U64         begin;
+  U64         end;
+  U64         frame;
+};
+
+struct ProfileThread {
+  U32          id;
+  ProfileEvent events[PROFILE_RING_SIZE];
+  U64          event_count; // total, the ring keeps the last PROFILE_RING_SIZE
+};
+
+struct ProfileZone {
+  const char *name;
+  U64         begin;
+};
+
+void profile_set_enabled(B32 enabled);
+B32  profile_enabled(void);
+void profile_frame_mark(U64 frame);
+
+ProfileZone profile_zone_begin(const char *name);
+void        profile_zone_end(ProfileZone *zone);
+
+// writes the events of frames [first_frame, last_frame] as chrome trace json (chrome://tracing, ui.perfetto.dev).
+// other threads should not record while this runs.
+B32 profile_write_chrome_trace(const char *path, U64 first_frame, U64 last_frame);
+
+C_LINKAGE_END
+
+#if LANG_CPP
+struct ProfileScope {
+  ProfileZone zone;
+
+  ProfileScope(const char *name) { zone = profile_zone_begin(name); }
+  ~ProfileScope() { profile_zone_end(&zone); }
+};
+
+#define ProfileGlue_(a, b) a##b
+#define ProfileGlue(a, b)  ProfileGlue_(a, b)
+#define ProfileScoped(name) ProfileScope ProfileGlue(profile_scope_, __LINE__)(name)
+#endif
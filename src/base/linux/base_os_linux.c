@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+
+#include "base/base_os.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+void *
+os_reserve(U64 size)
+{
+    void *result = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return result == MAP_FAILED ? 0 : result;
+}
+
+B32
+os_commit(void *ptr, U64 size)
+{
+    return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void
+os_decommit(void *ptr, U64 size)
+{
+    madvise(ptr, size, MADV_DONTNEED);
+    mprotect(ptr, size, PROT_NONE);
+}
+
+void
+os_release(void *ptr, U64 size)
+{
+    munmap(ptr, size);
+}
+
+FileProperties
+os_file_properties(const char *path)
+{
+    FileProperties props = {0};
+
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        props.exists   = 1;
+        props.size     = st.st_size;
+        props.modified = (U64)st.st_mtim.tv_sec * 1000000000ull + (U64)st.st_mtim.tv_nsec;
+    }
+
+    return props;
+}
+
+B32
+os_file_map(FileMap *map, const char *path)
+{
+    MemoryZero(map, sizeof(FileMap));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void *data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+
+    map->data = data;
+    map->size = st.st_size;
+
+    return 1;
+}
+
+void
+os_file_unmap(FileMap *map)
+{
+    if (map->data) {
+        munmap(map->data, map->size);
+    }
+
+    MemoryZero(map, sizeof(FileMap));
+}
+
+U64
+os_now_microseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (U64)ts.tv_sec * 1000000ull + (U64)ts.tv_nsec / 1000ull;
+}
+
+void
+os_sleep_milliseconds(U32 milliseconds)
+{
+    struct timespec ts;
+    ts.tv_sec  = milliseconds / 1000;
+    ts.tv_nsec = (long)(milliseconds % 1000) * 1000000l;
+    nanosleep(&ts, 0);
+}
+
+U32
+os_processor_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (U32)count : 1;
+}
+
+typedef struct LinuxThreadStart LinuxThreadStart;
+
+struct LinuxThreadStart {
+    ThreadFunction *func;
+    void           *param;
+};
+
+static void *
+linux_thread_entry(void *param)
+{
+    LinuxThreadStart start = *(LinuxThreadStart *)param;
+    free(param);
+
+    start.func(start.param);
+    return 0;
+}
+
+Thread
+os_thread_launch(ThreadFunction *func, void *param)
+{
+    LinuxThreadStart *start = malloc(sizeof(LinuxThreadStart));
+    start->func             = func;
+    start->param            = param;
+
+    pthread_t handle;
+    if (pthread_create(&handle, 0, linux_thread_entry, start) != 0) {
+        free(start);
+        log_fatal("Failed to launch thread!");
+    }
+
+    Thread thread = {0};
+    thread.handle = (void *)handle;
+    return thread;
+}
+
+void
+os_thread_join(Thread thread)
+{
+    pthread_join((pthread_t)thread.handle, 0);
+}
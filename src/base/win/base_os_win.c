@@ -1,5 +1,8 @@
 #include "base/base_os.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
@@ -26,3 +29,137 @@ os_release(void *ptr, U64 size)
 {
     VirtualFree(ptr, 0, MEM_RELEASE);
 }
+
+FileProperties
+os_file_properties(const char *path)
+{
+    FileProperties props = {0};
+
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+        props.exists   = 1;
+        props.size     = ((U64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        props.modified = ((U64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+    }
+
+    return props;
+}
+
+B32
+os_file_map(FileMap *map, const char *path)
+{
+    MemoryZero(map, sizeof(FileMap));
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    if (!mapping) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return 0;
+    }
+
+    map->data       = data;
+    map->size       = size.QuadPart;
+    map->handles[0] = file;
+    map->handles[1] = mapping;
+
+    return 1;
+}
+
+void
+os_file_unmap(FileMap *map)
+{
+    if (map->data) {
+        UnmapViewOfFile(map->data);
+        CloseHandle(map->handles[1]);
+        CloseHandle(map->handles[0]);
+    }
+
+    MemoryZero(map, sizeof(FileMap));
+}
+
+U64
+os_now_microseconds(void)
+{
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    return (U64)(counter.QuadPart / frequency.QuadPart) * 1000000ull +
+           (U64)(counter.QuadPart % frequency.QuadPart) * 1000000ull / frequency.QuadPart;
+}
+
+void
+os_sleep_milliseconds(U32 milliseconds)
+{
+    Sleep(milliseconds);
+}
+
+U32
+os_processor_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+typedef struct WinThreadStart WinThreadStart;
+
+struct WinThreadStart {
+    ThreadFunction *func;
+    void           *param;
+};
+
+static DWORD WINAPI
+win_thread_entry(LPVOID param)
+{
+    WinThreadStart start = *(WinThreadStart *)param;
+    free(param);
+
+    start.func(start.param);
+    return 0;
+}
+
+Thread
+os_thread_launch(ThreadFunction *func, void *param)
+{
+    WinThreadStart *start = malloc(sizeof(WinThreadStart));
+    start->func           = func;
+    start->param          = param;
+
+    Thread thread = {0};
+    thread.handle = CreateThread(0, 0, win_thread_entry, start, 0, 0);
+    if (!thread.handle) {
+        free(start);
+        log_fatal("Failed to launch thread!");
+    }
+
+    return thread;
+}
+
+void
+os_thread_join(Thread thread)
+{
+    WaitForSingleObject(thread.handle, INFINITE);
+    CloseHandle(thread.handle);
+}
@@ -36,7 +36,7 @@ gui_init(GLFWwindow *window, VkInstance instance, VkPhysicalDevice pdevice, Devi
   init_info.Device                    = ldevice->handle;
   init_info.QueueFamily               = ldevice->graphics_queue_index;
   init_info.Queue                     = ldevice->graphics_queue;
-  init_info.PipelineCache             = VK_NULL_HANDLE;
+  init_info.PipelineCache             = ldevice->pipeline_cache;
   init_info.DescriptorPool            = imgui_desc_pool;
   init_info.Subpass                   = 0;
   init_info.MinImageCount             = 2;
@@ -106,13 +106,116 @@ gui_render_materials(Materials *materials)
 
     Material *mat = &materials->materials[i];
 
-    ImGui::ColorEdit3("albedo", &mat->albedo.x);
-    ImGui::SliderFloat("metallic", &mat->metallic, 0.0f, 1.0f);
-    ImGui::SliderFloat("specular", &mat->specular, 0.0f, 1.0f);
-    ImGui::SliderFloat("roughness", &mat->roughness, 0.0f, 1.0f);
+    B32 changed = 0;
+    changed |= ImGui::ColorEdit3("albedo", &mat->albedo.x);
+    changed |= ImGui::SliderFloat("metallic", &mat->metallic, 0.0f, 1.0f);
+    changed |= ImGui::SliderFloat("specular", &mat->specular, 0.0f, 1.0f);
+    changed |= ImGui::SliderFloat("roughness", &mat->roughness, 0.0f, 1.0f);
+
+    if (changed) {
+      materials_mark_dirty(materials, i);
+    }
 
     ImGui::PopID();
   }
 
   ImGui::End();
 }
+
+void
+gui_render_memory(Device *ldevice)
+{
+  MemoryAllocator *allocator = &ldevice->allocator;
+
+  MemoryStats type_stats[VK_MAX_MEMORY_TYPES];
+  MemoryStats total;
+  memory_allocator_stats(allocator, type_stats, &total);
+
+  ImGui::Begin("Memory");
+
+  ImGui::Text("%llu allocations in %llu blocks (%llu dedicated)", (unsigned long long)total.allocation_count,
+              (unsigned long long)total.block_count, (unsigned long long)total.dedicated_block_count);
+  ImGui::Text("%.2f / %.2f MB used, fragmentation %.2f", (F64)total.used_bytes / MB(1), (F64)total.reserved_bytes / MB(1),
+              total.fragmentation);
+
+  if (ImGui::Button("Dump to log")) {
+    memory_allocator_dump(allocator);
+  }
+
+  if (ImGui::BeginTable("memory_types", 6)) {
+    ImGui::TableSetupColumn("type");
+    ImGui::TableSetupColumn("heap");
+    ImGui::TableSetupColumn("blocks");
+    ImGui::TableSetupColumn("allocations");
+    ImGui::TableSetupColumn("used / reserved MB");
+    ImGui::TableSetupColumn("fragmentation");
+    ImGui::TableHeadersRow();
+
+    for (U32 type = 0; type < allocator->memory_properties.memoryTypeCount; ++type) {
+      MemoryStats *stats = &type_stats[type];
+      if (stats->block_count == 0) {
+        continue;
+      }
+
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("%u", type);
+      ImGui::TableNextColumn();
+      ImGui::Text("%u", allocator->memory_properties.memoryTypes[type].heapIndex);
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)stats->block_count);
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)stats->allocation_count);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f / %.2f", (F64)stats->used_bytes / MB(1), (F64)stats->reserved_bytes / MB(1));
+      ImGui::TableNextColumn();
+      ImGui::Text("%.2f", stats->fragmentation);
+    }
+
+    ImGui::EndTable();
+  }
+
+  ImGui::End();
+}
+
+void
+gui_render_gpu_profiler(GpuProfiler *profiler)
+{
+  ImGui::Begin("GPU Profiler");
+
+  if (!profiler->supported) {
+    ImGui::Text("Timestamp queries are not supported");
+    ImGui::End();
+    return;
+  }
+
+  if (ImGui::BeginTable("gpu_passes", 5)) {
+    ImGui::TableSetupColumn("pass");
+    ImGui::TableSetupColumn("last ms");
+    ImGui::TableSetupColumn("min ms");
+    ImGui::TableSetupColumn("avg ms");
+    ImGui::TableSetupColumn("p99 ms");
+    ImGui::TableHeadersRow();
+
+    for (U32 pass = 0; pass < profiler->pass_count; ++pass) {
+      GpuProfilerStats stats;
+      gpu_profiler_pass_stats(profiler, pass, &stats);
+
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", profiler->passes[pass].name);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", stats.last);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", stats.min);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", stats.avg);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", stats.p99);
+    }
+
+    ImGui::EndTable();
+  }
+
+  ImGui::End();
+}
@@ -14,3 +14,5 @@ void gui_end_frame(VkCommandBuffer cmd_buf);
 void gui_render(void);
 
 void gui_render_materials(Materials *materials);
+void gui_render_memory(Device *ldevice);
+void gui_render_gpu_profiler(GpuProfiler *profiler);
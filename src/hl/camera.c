@@ -1,8 +1,7 @@
 #include "camera.h"
 
 #include <math.h>
-
-static void camera_update_view(Camera *c);
+#include <stdio.h>
 
 void
 camera_init(Camera *c, Vec3 look_at)
@@ -89,3 +88,66 @@ camera_update_view(Camera *c)
   c->view     = mat4_lookat(vec3(x, y, z), c->look_at, vec3(0, 1, 0));
   c->position = vec3(x, y, z);
 }
+
+void
+camera_set_key(Camera *c, CameraKey *key)
+{
+  c->yaw    = key->yaw;
+  c->pitch  = key->pitch;
+  c->radius = key->radius;
+
+  camera_update_view(c);
+}
+
+B32
+camera_path_load(CameraPath *path, Arena *arena, const char *file_path)
+{
+  path->keys  = 0;
+  path->count = 0;
+
+  FILE *f = fopen(file_path, "rb");
+  if (!f) {
+    return 0;
+  }
+
+  // keys are pushed one after another, so they end up contiguous in the arena
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    CameraKey key;
+    if (line[0] == '#' || sscanf(line, "%f %f %f", &key.yaw, &key.pitch, &key.radius) != 3) {
+      continue;
+    }
+
+    CameraKey *dst = push_array_no_zero(arena, CameraKey, 1);
+    if (!path->keys) {
+      path->keys = dst;
+    }
+
+    *dst = key;
+    path->count++;
+  }
+
+  fclose(f);
+
+  return path->count > 0;
+}
+
+// full turn around the look at point at the default pitch and radius
+void
+camera_path_orbit(CameraPath *path, Arena *arena, U32 count)
+{
+  path->keys  = push_array_no_zero(arena, CameraKey, count);
+  path->count = count;
+
+  for (U32 i = 0; i < count; ++i) {
+    path->keys[i].yaw    = -pi32 / 2.0f + 2.0f * pi32 * (F32)i / (F32)count;
+    path->keys[i].pitch  = pi32 / 4.0f;
+    path->keys[i].radius = 10.0f;
+  }
+}
+
+void
+camera_path_write_key(FILE *f, Camera *c)
+{
+  fprintf(f, "%f %f %f\n", c->yaw, c->pitch, c->radius);
+}
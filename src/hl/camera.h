@@ -2,14 +2,19 @@
 
 #include <GLFW/glfw3.h>
 
+#include <stdio.h>
+
 #include "base/base.h"
+#include "base/base_arena.h"
 
 #include "hl/input.h"
 #include "math/math.h"
 
 C_LINKAGE_BEGIN
 
-typedef struct Camera Camera;
+typedef struct Camera     Camera;
+typedef struct CameraKey  CameraKey;
+typedef struct CameraPath CameraPath;
 
 struct Camera {
   Mat4 projection;
@@ -22,8 +27,27 @@ struct Camera {
   F32  sensitivity;
 };
 
+// one orbit state per frame, recorded with --record-camera and replayed by the benchmark
+struct CameraKey {
+  F32 yaw;
+  F32 pitch;
+  F32 radius;
+};
+
+struct CameraPath {
+  CameraKey *keys;
+  U32        count;
+};
+
 void camera_init(Camera *c, Vec3 look_at);
 void camera_resize(Camera *c, U32 width, U32 height);
 void camera_update(Camera *c, Input *input, F32 delta);
+void camera_update_view(Camera *c);
+void camera_set_key(Camera *c, CameraKey *key);
+
+// text file, one "yaw pitch radius" line per frame, lines starting with # are ignored
+B32  camera_path_load(CameraPath *path, Arena *arena, const char *file_path);
+void camera_path_orbit(CameraPath *path, Arena *arena, U32 count);
+void camera_path_write_key(FILE *f, Camera *c);
 
 C_LINKAGE_END
@@ -1,11 +1,16 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "imgui.h"
 
 #include <GLFW/glfw3.h>
 
 #include "base/base.h"
+#include "base/base_arena.h"
+#include "base/base_os.h"
+#include "base/base_profile.h"
 
 #include "gui/vulkan_imgui.h"
 #include "models/models.h"
@@ -14,6 +19,10 @@
 #include "hl/camera.h"
 #include "hl/input.h"
 
+#include "stb_image_write.h"
+
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+
 // Keep this here so we know later where we have to use it
 static VkAllocationCallbacks *g_allocator = 0;
 static B8                     g_show_gui  = false;
@@ -52,7 +61,7 @@ postprocess_create(Device *ldevice, VkRenderPass render_pass, Texture *target_te
       {"assets/shaders/post.spv", VK_SHADER_STAGE_FRAGMENT_BIT},
   };
 
-  p.pipeline = pipeline_create(ldevice, &p.desc_set, render_pass, shaders, ArrayCount(shaders), 0, 0, 0, 0, VK_CULL_MODE_NONE);
+  p.pipeline = pipeline_create(ldevice, &p.desc_set, 1, render_pass, shaders, ArrayCount(shaders), 0, 0, 0, 0, VK_CULL_MODE_NONE);
 
   VkWriteDescriptorSet desc_write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
   desc_write.dstSet               = p.desc_set.handle;
@@ -83,7 +92,6 @@ struct WindowPointerInfo {
   Postprocess     *postprocess;
   Camera          *camera;
   Input           *input;
-  DiffuseTextures *diffuse_textures;
 };
 
 void
@@ -111,9 +119,8 @@ resize_callback(GLFWwindow *window, S32 width, S32 height)
   frame_buffers_destroy(info->frame_buffers, ldevice);
   *info->frame_buffers = frame_buffers_create(sc, info->render_pass, info->depth_buffer);
 
-  pbr_renderer_destroy(info->pbr_renderer, ldevice);
-  *info->pbr_renderer =
-      pbr_renderer_create(pdevice, ldevice, sc, info->cmd_pool, info->depth_buffer->format, info->diffuse_textures->count);
+  // only the render targets depend on the size, the pipeline and descriptors stay (viewport and scissor are dynamic)
+  pbr_renderer_resize(info->pbr_renderer, pdevice, ldevice, info->cmd_pool, sc->width, sc->height);
 
   VkWriteDescriptorSet desc_write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
   desc_write.dstSet               = info->postprocess->desc_set.handle;
@@ -140,9 +147,592 @@ key_callback(GLFWwindow *window, S32 key, S32 scancode, S32 action, S32 mods)
   }
 }
 
+struct TraceOptions {
+  const char *path;
+  U64         first_frame;
+  U64         last_frame;
+  B32         written;
+};
+
+// writes the trace once the last frame of the range is done, or at exit with whatever was recorded
+static void
+trace_frame_end(TraceOptions *trace, U64 frame, B32 exiting)
+{
+  if (!trace->path || trace->written || (frame < trace->last_frame && !exiting)) {
+    return;
+  }
+
+  profile_set_enabled(0);
+  profile_write_chrome_trace(trace->path, trace->first_frame, trace->last_frame);
+  trace->written = 1;
+}
+
+struct HeadlessOptions {
+  B32         enabled;
+  U32         width;
+  U32         height;
+  U32         frame_count;
+  const char *out_path;
+  const char *scene_path;
+};
+
+// everything a run without window needs, shared by --headless and --bench
+struct HeadlessContext {
+  VkInstance                 instance;
+  VkPhysicalDevice           pdevice;
+  VkPhysicalDeviceProperties properties;
+  Device                     ldevice;
+  VkCommandPool              cmd_pool;
+  Uploader                   uploader;
+  Frames                     frames;
+};
+
+struct HeadlessScene {
+  DiffuseTextures diffuse_textures;
+  Materials       materials;
+  Models          models;
+  ModelInstances  instances;
+  PBRRenderer     pbr_renderer;
+};
+
+static void
+headless_context_create(HeadlessContext *ctx, U32 frames_in_flight)
+{
+  const char *layers[] = {"VK_LAYER_KHRONOS_validation"};
+
+  ctx->instance = vulkan_instance_create("Raytracer", VK_API_VERSION_1_2, 0, 0, layers, ArrayCount(layers));
+
+  ctx->pdevice = physical_device_find_compatible(ctx->instance, 0, 0);
+  if (!ctx->pdevice) {
+    log_fatal("Failed to find compatible GPU device!");
+  }
+  vkGetPhysicalDeviceProperties(ctx->pdevice, &ctx->properties);
+
+  ctx->ldevice = logical_device_create(VK_NULL_HANDLE, ctx->pdevice, 0, 0, layers, ArrayCount(layers));
+  pipeline_cache_create(&ctx->ldevice, ctx->pdevice, PIPELINE_CACHE_PATH);
+
+  ctx->cmd_pool = command_pool_create(&ctx->ldevice, ctx->ldevice.graphics_queue_index);
+  ctx->uploader = uploader_create(&ctx->ldevice, MB(64));
+  ctx->frames   = frames_create(ctx->pdevice, &ctx->ldevice, frames_in_flight);
+}
+
+static void
+headless_context_destroy(HeadlessContext *ctx)
+{
+  frames_destroy(&ctx->frames, &ctx->ldevice);
+  uploader_destroy(&ctx->uploader);
+  command_pool_destroy(ctx->cmd_pool, &ctx->ldevice);
+  pipeline_cache_destroy(&ctx->ldevice, ctx->pdevice, PIPELINE_CACHE_PATH);
+  logical_device_destroy(&ctx->ldevice);
+  vulkan_instance_destroy(ctx->instance);
+}
+
+// Lays count copies of the model out on a grid in the xz plane, neighbours are a quarter of the model apart.
+// The copies share the model's buffers and are drawn with one instanced draw.
+static void
+scene_add_instance_grid(ModelInstances *instances, Model *model, U32 count)
+{
+  Temp scratch = scratch_begin(0, 0);
+
+  Mat4 *transforms = push_array_no_zero(scratch.arena, Mat4, count);
+
+  U32 columns   = (U32)ceilf(sqrtf((F32)count));
+  U32 rows      = (count + columns - 1) / columns;
+  F32 spacing_x = (model->bounds_max.x - model->bounds_min.x) * 1.25f;
+  F32 spacing_z = (model->bounds_max.z - model->bounds_min.z) * 1.25f;
+
+  for (U32 i = 0; i < count; ++i) {
+    F32 x         = ((F32)(i % columns) - (F32)(columns - 1) * 0.5f) * spacing_x;
+    F32 z         = ((F32)(i / columns) - (F32)(rows - 1) * 0.5f) * spacing_z;
+    transforms[i] = mat4_translation(vec3(x, 0.0f, z));
+  }
+
+  model_instances_add(instances, model, transforms, count);
+
+  scratch_end(scratch);
+}
+
+// returns once everything is on the gpu, so the caller can time the whole load
+static void
+headless_scene_load(HeadlessScene *scene, HeadlessContext *ctx, const char *path, U32 width, U32 height, U32 instance_count)
+{
+  VkPhysicalDevice pdevice = ctx->pdevice;
+  Device          *ldevice = &ctx->ldevice;
+
+  diffuse_textures_init(&scene->diffuse_textures);
+  materials_init(&scene->materials);
+  models_init(&scene->models);
+  model_instances_init(&scene->instances);
+
+  U32 model = model_load(pdevice, ldevice, &ctx->uploader, &scene->models, &scene->materials, &scene->diffuse_textures, path);
+  scene_add_instance_grid(&scene->instances, &scene->models.models[model], instance_count);
+
+  scene->pbr_renderer = pbr_renderer_create(pdevice, ldevice, &ctx->frames, width, height, ctx->cmd_pool, image_find_depth_format(pdevice),
+                                            scene->diffuse_textures.count);
+
+  materials_write_descriptors(&scene->materials, pdevice, ldevice, &ctx->uploader, &scene->pbr_renderer.desc_set);
+  diffuse_textures_write_descriptors(&scene->diffuse_textures, ldevice, &scene->pbr_renderer.texture_set);
+  models_write_descriptors(&scene->models, pdevice, ldevice, &ctx->uploader, &scene->pbr_renderer.desc_set);
+  model_instances_write_descriptors(&scene->instances, pdevice, ldevice, &ctx->uploader, &scene->pbr_renderer.desc_set);
+
+  uploader_flush(&ctx->uploader);
+  uploader_wait(&ctx->uploader);
+}
+
+static void
+headless_scene_free(HeadlessScene *scene, HeadlessContext *ctx)
+{
+  models_free(&scene->models, &ctx->ldevice);
+  model_instances_free(&scene->instances, &ctx->ldevice);
+  diffuse_textures_free(&scene->diffuse_textures, &ctx->ldevice);
+  materials_free(&scene->materials, &ctx->ldevice);
+  pbr_renderer_destroy(&scene->pbr_renderer, &ctx->ldevice);
+}
+
+static void
+headless_scene_record(HeadlessScene *scene, Frame *frame, Camera *camera, GpuProfiler *profiler)
+{
+  VkCommandBuffer cmd_buf = frame->cmd_buf;
+
+  VkClearValue clear_colors[2] = {0};
+  clear_colors[0].color        = {{0.0f, 0.0f, 0.0f, 1.0f}};
+  clear_colors[1].depthStencil = {1.0f, 0};
+
+  materials_update_uniforms(&scene->materials, frame);
+
+  GlobalUniforms uniforms = {camera->projection, camera->view, camera->position};
+  pbr_renderer_update_uniforms(&scene->pbr_renderer, frame, &uniforms);
+
+  U32 pbr_marker = gpu_profiler_begin(profiler, cmd_buf, "pbr");
+  pbr_renderer_render(&scene->pbr_renderer, cmd_buf, &scene->models, clear_colors);
+  gpu_profiler_end(profiler, cmd_buf, pbr_marker);
+}
+
+// same as the post shader, the png ends up looking like the window
+static void
+headless_write_png(const char *path, F32 *pixels, U32 width, U32 height)
+{
+  Temp scratch = scratch_begin(0, 0);
+
+  U8 *rgba = push_array_no_zero(scratch.arena, U8, (U64)width * height * 4);
+  for (U64 i = 0; i < (U64)width * height * 4; ++i) {
+    F32 value = (i % 4) == 3 ? pixels[i] : powf(Max(pixels[i], 0.0f), 1.0f / 2.2f);
+    rgba[i]   = (U8)(Min(value, 1.0f) * 255.0f + 0.5f);
+  }
+
+  if (!stbi_write_png(path, width, height, 4, rgba, width * 4)) {
+    log_fatal("Failed to write %s!", path);
+  }
+
+  scratch_end(scratch);
+}
+
+// Renders the scene without window, surface or swapchain into the PBRRenderer color target and dumps the last frame.
+// Works with software implementations like lavapipe, so it can run on machines without a gpu.
+static S32
+headless_run(HeadlessOptions *opts, TraceOptions *trace, U32 frames_in_flight, U32 instance_count)
+{
+  HeadlessContext ctx = {};
+  headless_context_create(&ctx, frames_in_flight);
+
+  Device *ldevice = &ctx.ldevice;
+
+  if (!os_file_properties(opts->scene_path).exists) {
+    log_fatal("Headless scene %s does not exist!", opts->scene_path);
+  }
+
+  HeadlessScene scene = {};
+  headless_scene_load(&scene, &ctx, opts->scene_path, opts->width, opts->height, instance_count);
+
+  Camera camera;
+  camera_init(&camera, vec3(0.0, 0.0, 0.0));
+  camera_resize(&camera, opts->width, opts->height);
+
+  Buffer readback = buffer_create_readback((VkDeviceSize)opts->width * opts->height * 4 * sizeof(F32), ctx.pdevice, ldevice);
+
+  Temp scratch = scratch_begin(0, 0);
+
+  F64 *cpu_times = push_array(scratch.arena, F64, opts->frame_count);
+  F32 *gpu_times = push_array(scratch.arena, F32, opts->frame_count);
+
+  GpuProfiler profiler      = gpu_profiler_create(ctx.pdevice, ldevice, ctx.frames.count);
+  profiler.frame_times      = gpu_times;
+  profiler.frame_time_count = opts->frame_count;
+
+  for (U32 i = 0; i < opts->frame_count; ++i) {
+    profile_frame_mark(i);
+
+    ProfileZone wait_zone = profile_zone_begin("frames_begin");
+    Frame      *frame     = frames_begin(&ctx.frames, ldevice);
+    profile_zone_end(&wait_zone);
+
+    // cpu time is recording and submitting, waiting for the frame slot is not included
+    U64             cpu_begin = os_now_microseconds();
+    VkCommandBuffer cmd_buf   = frame->cmd_buf;
+    ProfileZone     record    = profile_zone_begin("record");
+
+    gpu_profiler_begin_frame(&profiler, ldevice, cmd_buf, ctx.frames.index, i);
+
+    headless_scene_record(&scene, frame, &camera, &profiler);
+
+    if (i == opts->frame_count - 1) {
+      U32 readback_marker = gpu_profiler_begin(&profiler, cmd_buf, "readback");
+      image_copy_to_buffer(cmd_buf, &scene.pbr_renderer.color_image.image, VK_IMAGE_LAYOUT_GENERAL, opts->width, opts->height, &readback);
+      gpu_profiler_end(&profiler, cmd_buf, readback_marker);
+    }
+
+    profile_zone_end(&record);
+
+    ProfileZone submit = profile_zone_begin("submit");
+    frames_submit(frame, ldevice);
+    frames_end(&ctx.frames);
+    profile_zone_end(&submit);
+
+    cpu_times[i] = (F64)(os_now_microseconds() - cpu_begin) / 1000.0;
+
+    trace_frame_end(trace, i, 0);
+  }
+
+  vkDeviceWaitIdle(ldevice->handle);
+  trace_frame_end(trace, opts->frame_count, 1);
+  gpu_profiler_collect(&profiler, ldevice);
+
+  // per frame and summary report on stdout
+  F64 cpu_total = 0.0;
+  for (U32 i = 0; i < opts->frame_count; ++i) {
+    if (profiler.supported) {
+      printf("frame %u: cpu %.3f ms, gpu %.3f ms\n", i, cpu_times[i], gpu_times[i]);
+    } else {
+      printf("frame %u: cpu %.3f ms, gpu n/a\n", i, cpu_times[i]);
+    }
+
+    cpu_total += cpu_times[i];
+  }
+
+  printf("%s, %ux%u, %u frames, %u in flight\n", ctx.properties.deviceName, opts->width, opts->height, opts->frame_count,
+         ctx.frames.count);
+  printf("cpu avg %.3f ms\n", cpu_total / opts->frame_count);
+
+  // history is capped, so these cover the last GPU_PROFILER_HISTORY_MAX frames
+  for (U32 pass = 0; pass < profiler.pass_count; ++pass) {
+    GpuProfilerStats stats;
+    gpu_profiler_pass_stats(&profiler, pass, &stats);
+
+    printf("gpu %-10s min %.3f ms, avg %.3f ms, p99 %.3f ms (%u samples)\n", profiler.passes[pass].name, stats.min, stats.avg, stats.p99,
+           stats.count);
+  }
+
+  headless_write_png(opts->out_path, (F32 *)buffer_map(&readback), opts->width, opts->height);
+  printf("wrote %s\n", opts->out_path);
+
+  scratch_end(scratch);
+
+  gpu_profiler_destroy(&profiler, ldevice);
+  buffer_destroy(&readback, ldevice);
+  headless_scene_free(&scene, &ctx);
+  headless_context_destroy(&ctx);
+
+  return 0;
+}
+
+#define BENCH_SCENE_MAX     32
+#define BENCH_WARMUP_FRAMES 16
+
+struct BenchOptions {
+  B32         enabled;
+  const char *out_path;
+  const char *camera_path; // optional, a full orbit otherwise
+  U32         frame_count;
+  const char *scenes[BENCH_SCENE_MAX];
+  U32         scene_count;
+};
+
+struct BenchStats {
+  F64 min;
+  F64 avg;
+  F64 p50;
+  F64 p90;
+  F64 p99;
+  F64 max;
+};
+
+static int
+bench_compare(const void *a, const void *b)
+{
+  F64 x = *(const F64 *)a;
+  F64 y = *(const F64 *)b;
+  return (x > y) - (x < y);
+}
+
+static BenchStats
+bench_stats(F64 *values, U32 count)
+{
+  BenchStats stats = {};
+  if (count == 0) {
+    return stats;
+  }
+
+  Temp scratch = scratch_begin(0, 0);
+
+  F64 *sorted = push_array_no_zero(scratch.arena, F64, count);
+  MemoryCopy(sorted, values, count * sizeof(F64));
+  qsort(sorted, count, sizeof(F64), bench_compare);
+
+  F64 sum = 0.0;
+  for (U32 i = 0; i < count; ++i) {
+    sum += sorted[i];
+  }
+
+  stats.min = sorted[0];
+  stats.avg = sum / count;
+  stats.p50 = sorted[(count - 1) * 50 / 100];
+  stats.p90 = sorted[(count - 1) * 90 / 100];
+  stats.p99 = sorted[(count - 1) * 99 / 100];
+  stats.max = sorted[count - 1];
+
+  scratch_end(scratch);
+
+  return stats;
+}
+
+static void
+bench_write_stats(FILE *f, const char *name, BenchStats *stats)
+{
+  fprintf(f, "      \"%s\": {\"min\": %.4f, \"avg\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}", name,
+          stats->min, stats->avg, stats->p50, stats->p90, stats->p99, stats->max);
+}
+
+// Loads every scene on its own, replays the camera path over it and writes one json report for all of them.
+// Keys are written in a fixed order with fixed precision, so reports of two commits can be diffed directly.
+static S32
+bench_run(BenchOptions *opts, U32 width, U32 height, U32 frames_in_flight, U32 instance_count)
+{
+  HeadlessContext ctx = {};
+  headless_context_create(&ctx, frames_in_flight);
+
+  Device *ldevice = &ctx.ldevice;
+
+  Arena *arena = arena_alloc(MB(64));
+
+  CameraPath camera_path = {};
+  if (opts->camera_path && !camera_path_load(&camera_path, arena, opts->camera_path)) {
+    log_fatal("Failed to load camera path %s!", opts->camera_path);
+  }
+  if (!camera_path.count) {
+    camera_path_orbit(&camera_path, arena, opts->frame_count);
+  }
+
+  FILE *f = fopen(opts->out_path, "wb");
+  if (!f) {
+    log_fatal("Failed to write %s!", opts->out_path);
+  }
+
+  fprintf(f, "{\n");
+  fprintf(f, "  \"device\": \"%s\",\n", ctx.properties.deviceName);
+  fprintf(f, "  \"driver_version\": %u,\n", ctx.properties.driverVersion);
+  fprintf(f, "  \"width\": %u,\n", width);
+  fprintf(f, "  \"height\": %u,\n", height);
+  fprintf(f, "  \"frames\": %u,\n", opts->frame_count);
+  fprintf(f, "  \"warmup_frames\": %u,\n", BENCH_WARMUP_FRAMES);
+  fprintf(f, "  \"frames_in_flight\": %u,\n", ctx.frames.count);
+  fprintf(f, "  \"instances_per_scene\": %u,\n", instance_count);
+  fprintf(f, "  \"camera_path\": \"%s\",\n", opts->camera_path ? opts->camera_path : "orbit");
+  fprintf(f, "  \"scenes\": [");
+
+  F64 *frame_times   = push_array(arena, F64, opts->frame_count);
+  F64 *gpu_times     = push_array(arena, F64, opts->frame_count);
+  F32 *gpu_times_raw = push_array(arena, F32, BENCH_WARMUP_FRAMES + opts->frame_count);
+
+  for (U32 s = 0; s < opts->scene_count; ++s) {
+    const char *path = opts->scenes[s];
+
+    fprintf(f, "%s\n    {\n      \"path\": \"%s\",\n", s ? "," : "", path);
+
+    // large stress scenes are not part of the repository
+    if (!os_file_properties(path).exists) {
+      log_dev("Skipping missing scene %s", path);
+      fprintf(f, "      \"status\": \"missing\"\n    }");
+      continue;
+    }
+
+    U64           load_begin = os_now_microseconds();
+    HeadlessScene scene      = {};
+    headless_scene_load(&scene, &ctx, path, width, height, instance_count);
+    F64 load_ms = (F64)(os_now_microseconds() - load_begin) / 1000.0;
+
+    MemoryStats type_stats[VK_MAX_MEMORY_TYPES];
+    MemoryStats memory;
+    memory_allocator_stats(&ldevice->allocator, type_stats, &memory);
+
+    Camera camera;
+    camera_init(&camera, vec3(0.0, 0.0, 0.0));
+    camera_resize(&camera, width, height);
+
+    GpuProfiler profiler      = gpu_profiler_create(ctx.pdevice, ldevice, ctx.frames.count);
+    profiler.frame_times      = gpu_times_raw;
+    profiler.frame_time_count = BENCH_WARMUP_FRAMES + opts->frame_count;
+
+    // frame time includes waiting for the frame slot, so it is the actual throughput
+    for (U32 i = 0; i < BENCH_WARMUP_FRAMES + opts->frame_count; ++i) {
+      U64 frame_begin = os_now_microseconds();
+
+      camera_set_key(&camera, &camera_path.keys[i % camera_path.count]);
+
+      Frame *frame = frames_begin(&ctx.frames, ldevice);
+      gpu_profiler_begin_frame(&profiler, ldevice, frame->cmd_buf, ctx.frames.index, i);
+      headless_scene_record(&scene, frame, &camera, &profiler);
+      frames_submit(frame, ldevice);
+      frames_end(&ctx.frames);
+
+      if (i >= BENCH_WARMUP_FRAMES) {
+        frame_times[i - BENCH_WARMUP_FRAMES] = (F64)(os_now_microseconds() - frame_begin) / 1000.0;
+      }
+    }
+
+    vkDeviceWaitIdle(ldevice->handle);
+    gpu_profiler_collect(&profiler, ldevice);
+
+    for (U32 i = 0; i < opts->frame_count; ++i) {
+      gpu_times[i] = gpu_times_raw[BENCH_WARMUP_FRAMES + i];
+    }
+
+    BenchStats frame_stats = bench_stats(frame_times, opts->frame_count);
+    BenchStats gpu_stats   = bench_stats(gpu_times, profiler.supported ? opts->frame_count : 0);
+
+    fprintf(f, "      \"status\": \"ok\",\n");
+    fprintf(f, "      \"load_ms\": %.4f,\n", load_ms);
+    fprintf(f, "      \"draw_calls\": %u,\n", scene.pbr_renderer.draw_count);
+    fprintf(f, "      \"instances\": %u,\n", scene.pbr_renderer.instance_count);
+    fprintf(f, "      \"triangles\": %llu,\n", (unsigned long long)scene.pbr_renderer.triangle_count);
+    fprintf(f, "      \"materials\": %u,\n", scene.materials.count);
+    fprintf(f, "      \"gpu_memory_used_bytes\": %llu,\n", (unsigned long long)memory.used_bytes);
+    fprintf(f, "      \"gpu_memory_reserved_bytes\": %llu,\n", (unsigned long long)memory.reserved_bytes);
+    bench_write_stats(f, "frame_ms", &frame_stats);
+    fprintf(f, ",\n");
+    bench_write_stats(f, "gpu_ms", &gpu_stats);
+    fprintf(f, "\n    }");
+
+    printf("%s: load %.2f ms, frame p50 %.3f ms p99 %.3f ms, gpu p50 %.3f ms p99 %.3f ms\n", path, load_ms, frame_stats.p50,
+           frame_stats.p99, gpu_stats.p50, gpu_stats.p99);
+
+    gpu_profiler_destroy(&profiler, ldevice);
+    headless_scene_free(&scene, &ctx);
+  }
+
+  fprintf(f, "\n  ]\n}\n");
+  fclose(f);
+
+  printf("wrote %s\n", opts->out_path);
+
+  arena_release(arena);
+  headless_context_destroy(&ctx);
+
+  return 0;
+}
+
 S32
 main(S32 argc, char *argv[])
 {
+  // number of frames the cpu may record ahead of the gpu
+  U32 frames_in_flight = FRAMES_IN_FLIGHT_DEFAULT;
+
+  // copies of the loaded model, laid out on a grid and drawn instanced
+  U32 instance_count = 1;
+
+  // writes the orbit state of every frame, replayed with --bench-camera
+  const char *record_camera_path = 0;
+
+  TraceOptions trace = {0};
+  trace.last_frame   = 59;
+
+  HeadlessOptions headless = {0};
+  headless.frame_count     = 100;
+  headless.out_path        = "headless.png";
+  headless.scene_path      = "assets/models/sphere.obj";
+
+  // recorded with --record-camera, --bench-camera replaces it
+  BenchOptions bench = {0};
+  bench.frame_count  = 300;
+  bench.camera_path  = "assets/camera/flythrough.txt";
+
+  for (S32 i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+      U32 count        = (U32)atoi(argv[++i]);
+      frames_in_flight = Clamp(1, count, FRAMES_IN_FLIGHT_MAX);
+    } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+      U32 count      = (U32)atoi(argv[++i]);
+      instance_count = Max(1, count);
+    } else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+      if (sscanf(argv[++i], "%ux%u", &headless.width, &headless.height) != 2 || headless.width == 0 || headless.height == 0) {
+        log_fatal("Expected --headless WIDTHxHEIGHT, got %s", argv[i]);
+      }
+      headless.enabled = 1;
+    } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      U32 count            = (U32)atoi(argv[++i]);
+      headless.frame_count = Max(1, count);
+    } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      headless.out_path = argv[++i];
+    } else if (strcmp(argv[i], "--headless-scene") == 0 && i + 1 < argc) {
+      headless.scene_path = argv[++i];
+    } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+      bench.enabled  = 1;
+      bench.out_path = argv[++i];
+    } else if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc) {
+      U32 count         = (U32)atoi(argv[++i]);
+      bench.frame_count = Max(1, count);
+    } else if (strcmp(argv[i], "--bench-camera") == 0 && i + 1 < argc) {
+      // "orbit" replays the synthetic orbit instead of a recorded path
+      const char *path  = argv[++i];
+      bench.camera_path = strcmp(path, "orbit") == 0 ? 0 : path;
+    } else if (strcmp(argv[i], "--bench-scene") == 0 && i + 1 < argc) {
+      const char *scene = argv[++i];
+      if (bench.scene_count < BENCH_SCENE_MAX) {
+        bench.scenes[bench.scene_count++] = scene;
+      } else {
+        log_dev("Dropping bench scene %s, at most %u scenes are benchmarked", scene, BENCH_SCENE_MAX);
+      }
+    } else if (strcmp(argv[i], "--record-camera") == 0 && i + 1 < argc) {
+      record_camera_path = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace.path = argv[++i];
+    } else if (strcmp(argv[i], "--trace-frames") == 0 && i + 1 < argc) {
+      unsigned long long first, last;
+      if (sscanf(argv[++i], "%llu-%llu", &first, &last) != 2 || first > last) {
+        log_fatal("Expected --trace-frames FIRST-LAST, got %s", argv[i]);
+      }
+      trace.first_frame = first;
+      trace.last_frame  = last;
+    }
+  }
+
+  // zones are recorded from the start, loading ends up in frame 0
+  if (trace.path) {
+    profile_set_enabled(1);
+  }
+
+  if (bench.enabled) {
+    // the default suite, --bench-scene replaces it. Large stress scenes are not in the repository and have to be passed.
+    const char *default_scenes[] = {
+        "assets/models/cube.obj",
+        "assets/models/sphere.obj",
+        "assets/models/Prop_Well_1.obj",
+    };
+
+    if (bench.scene_count == 0) {
+      for (U32 i = 0; i < ArrayCount(default_scenes); ++i) {
+        bench.scenes[bench.scene_count++] = default_scenes[i];
+      }
+    }
+
+    U32 width  = headless.enabled ? headless.width : 1280;
+    U32 height = headless.enabled ? headless.height : 720;
+    return bench_run(&bench, width, height, frames_in_flight, instance_count);
+  }
+
+  if (headless.enabled) {
+    return headless_run(&headless, &trace, frames_in_flight, instance_count);
+  }
+
   glfwSetErrorCallback(glfw_error_callback);
   if (!glfwInit()) {
     log_fatal("Failed to initialize GLFW!");
@@ -177,15 +767,18 @@ main(S32 argc, char *argv[])
   }
 
   Device ldevice = logical_device_create(surface, pdevice, device_extensions, ArrayCount(device_extensions), layers, ArrayCount(layers));
+  pipeline_cache_create(&ldevice, pdevice, PIPELINE_CACHE_PATH);
 
-  VkCommandPool cmd_pool = command_pool_create(&ldevice);
+  VkCommandPool cmd_pool = command_pool_create(&ldevice, ldevice.graphics_queue_index);
+  Uploader      uploader = uploader_create(&ldevice, MB(64));
 
   Swapchain swapchain = swapchain_create(2, surface, pdevice, &ldevice, cmd_pool);
 
-  Image          depth_image         = image_create_depth(pdevice, &ldevice, &swapchain, cmd_pool);
-  VkRenderPass   present_render_pass = render_pass_create_present(swapchain.format.format, depth_image.format, &ldevice);
-  Framebuffers   frame_buffers       = frame_buffers_create(&swapchain, present_render_pass, &depth_image);
-  CommandBuffers cmd_bufs            = command_buffers_allocate(&ldevice, cmd_pool, swapchain.image_count);
+  Image        depth_image         = image_create_depth(pdevice, &ldevice, &swapchain, cmd_pool);
+  VkRenderPass present_render_pass = render_pass_create_present(swapchain.format.format, depth_image.format, &ldevice);
+  Framebuffers frame_buffers       = frame_buffers_create(&swapchain, present_render_pass, &depth_image);
+  Frames       frames              = frames_create(pdevice, &ldevice, frames_in_flight);
+  GpuProfiler  profiler            = gpu_profiler_create(pdevice, &ldevice, frames.count);
 
   DiffuseTextures diffuse_textures = {};
   diffuse_textures_init(&diffuse_textures);
@@ -193,39 +786,31 @@ main(S32 argc, char *argv[])
   Materials materials = {};
   materials_init(&materials);
 
-  Model           model      = {};
-  ModelDescriptor model_desc = model_load(pdevice, &ldevice, cmd_pool, &model, &materials, &diffuse_textures, "assets/models/sphere.obj");
+  Models models = {};
+  models_init(&models);
 
-  PBRRenderer pbr_renderer = pbr_renderer_create(pdevice, &ldevice, &swapchain, cmd_pool, depth_image.format, diffuse_textures.count);
+  ModelInstances instances = {};
+  model_instances_init(&instances);
+
+  U32 model = model_load(pdevice, &ldevice, &uploader, &models, &materials, &diffuse_textures, "assets/models/sphere.obj");
+  scene_add_instance_grid(&instances, &models.models[model], instance_count);
+
+  PBRRenderer pbr_renderer = pbr_renderer_create(pdevice, &ldevice, &frames, swapchain.width, swapchain.height, cmd_pool,
+                                                 depth_image.format, diffuse_textures.count);
   Postprocess postprocess  = postprocess_create(&ldevice, present_render_pass, &pbr_renderer.color_image);
 
   VkDescriptorPool imgui_desc_pool = gui_init(window, instance, pdevice, &ldevice, swapchain.image_count, present_render_pass, cmd_pool);
 
   // after loading models when we know which materials are used
-  materials_write_descriptors(&materials, pdevice, &ldevice, cmd_pool, &pbr_renderer.desc_set);
-
-  // write diffuse textures to descriptor set
-  /*
-  if (diffuse_textures.count > 0) {
-      VkDescriptorImageInfo *image_infos = (VkDescriptorImageInfo *)malloc(diffuse_textures.count * sizeof(VkDescriptorImageInfo));
-      for (U32 i = 0; i < diffuse_textures.count; i++) {
-          image_infos[i] = diffuse_textures.textures[i].descriptor;
-      }
+  materials_write_descriptors(&materials, pdevice, &ldevice, &uploader, &pbr_renderer.desc_set);
 
-      // Write diffuse textures
-      VkWriteDescriptorSet desc_write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-      desc_write.dstSet               = pbr_renderer.desc_set.handle;
-      desc_write.dstBinding           = 3;
-      desc_write.descriptorCount      = diffuse_textures.count;
-      desc_write.descriptorType       = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-      desc_write.pImageInfo           = image_infos;
+  diffuse_textures_write_descriptors(&diffuse_textures, &ldevice, &pbr_renderer.texture_set);
 
-      vkUpdateDescriptorSets(ldevice.handle, 1, &desc_write, 0, 0);
+  models_write_descriptors(&models, pdevice, &ldevice, &uploader, &pbr_renderer.desc_set);
+  model_instances_write_descriptors(&instances, pdevice, &ldevice, &uploader, &pbr_renderer.desc_set);
 
-      free(image_infos);
-  }*/
-
-  models_write_descriptors(pdevice, &ldevice, cmd_pool, &pbr_renderer.desc_set, &model_desc, 1);
+  // the whole scene goes to the gpu in one submit, frames are submitted after it on the same queue
+  uploader_flush(&uploader);
 
   Input input;
   input_init(&input, window);
@@ -244,16 +829,29 @@ main(S32 argc, char *argv[])
   wp_info.postprocess       = &postprocess;
   wp_info.camera            = &camera;
   wp_info.input             = &input;
-  wp_info.diffuse_textures  = &diffuse_textures;
 
   glfwSetWindowUserPointer(window, &wp_info);
   glfwSetFramebufferSizeCallback(window, resize_callback);
   glfwSetKeyCallback(window, key_callback);
 
+  FILE *record_camera = 0;
+  if (record_camera_path) {
+    record_camera = fopen(record_camera_path, "wb");
+    if (!record_camera) {
+      log_fatal("Failed to write %s!", record_camera_path);
+    }
+    fprintf(record_camera, "# yaw pitch radius\n");
+  }
+
   F32 last_frame_time = glfwGetTime();
 
   while (!glfwWindowShouldClose(window)) {
+    profile_frame_mark(frames.number);
+    ProfileZone frame_zone = profile_zone_begin("frame");
+
+    ProfileZone zone = profile_zone_begin("poll_events");
     glfwPollEvents();
+    profile_zone_end(&zone);
 
     // calculate delta
     F32 current_frame_time = glfwGetTime();
@@ -261,33 +859,58 @@ main(S32 argc, char *argv[])
     last_frame_time        = current_frame_time;
 
     // update input and camera
+    zone = profile_zone_begin("input_update");
     input_update(&input);
+    profile_zone_end(&zone);
+
+    zone = profile_zone_begin("camera_update");
     camera_update(&camera, &input, delta_frame_time);
+    profile_zone_end(&zone);
+
+    if (record_camera) {
+      camera_path_write_key(record_camera, &camera);
+    }
 
     // render imgui windows
+    zone = profile_zone_begin("gui");
     gui_new_frame();
 
     if (g_show_gui) {
       gui_render_materials(&materials);
+      gui_render_memory(&ldevice);
+      gui_render_gpu_profiler(&profiler);
     }
+    profile_zone_end(&zone);
+
+    // waits until the frame slot is free again, then acquire an image from the swapchain
+    zone         = profile_zone_begin("frames_begin");
+    Frame *frame = frames_begin(&frames, &ldevice);
+    profile_zone_end(&zone);
 
-    // acquiring image from swapchain and command buffer for frame
-    U32             current_image = swapchain_acquire(&swapchain);
-    VkCommandBuffer cmd_buf       = cmd_bufs.handles[current_image];
-    command_buffer_begin(cmd_buf);
+    zone                          = profile_zone_begin("acquire");
+    U32             current_image = swapchain_acquire(&swapchain, frame);
+    VkCommandBuffer cmd_buf       = frame->cmd_buf;
+    profile_zone_end(&zone);
+
+    ProfileZone record = profile_zone_begin("record");
+
+    gpu_profiler_begin_frame(&profiler, &ldevice, cmd_buf, frames.index, frames.number);
 
     VkClearValue clear_colors[2] = {0};
     clear_colors[0].color        = {{0.0f, 0.0f, 0.0f, 1.0f}};
     clear_colors[1].depthStencil = {1.0f, 0};
 
-    // Scene
-    // @Todo only do on change
-    materials_update_uniforms(&materials, cmd_buf);
+    // Scene, only materials that changed since the last frame are uploaded
+    zone = profile_zone_begin("material_upload");
+    materials_update_uniforms(&materials, frame);
+    profile_zone_end(&zone);
 
-    // @Todo only do on change (we can get that from update probably)
     GlobalUniforms uniforms = {camera.projection, camera.view, camera.position};
-    pbr_renderer_update_uniforms(&pbr_renderer, cmd_buf, &uniforms);
-    pbr_renderer_render(&pbr_renderer, &swapchain, cmd_buf, &model, 1, clear_colors);
+    pbr_renderer_update_uniforms(&pbr_renderer, frame, &uniforms);
+
+    U32 pbr_marker = gpu_profiler_begin(&profiler, cmd_buf, "pbr");
+    pbr_renderer_render(&pbr_renderer, cmd_buf, &models, clear_colors);
+    gpu_profiler_end(&profiler, cmd_buf, pbr_marker);
 
     // Render UI
     {
@@ -310,32 +933,55 @@ main(S32 argc, char *argv[])
       vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, postprocess.pipeline.layout, 0, 1, &postprocess.desc_set.handle, 0,
                               0);
 
+      U32 post_marker = gpu_profiler_begin(&profiler, cmd_buf, "postprocess");
       vkCmdDraw(cmd_buf, 3, 1, 0, 0);
+      gpu_profiler_end(&profiler, cmd_buf, post_marker);
 
+      U32 gui_marker = gpu_profiler_begin(&profiler, cmd_buf, "imgui");
       gui_end_frame(cmd_buf);
+      gpu_profiler_end(&profiler, cmd_buf, gui_marker);
+
       vkCmdEndRenderPass(cmd_buf);
     }
 
     // present render imaged and end frame
     command_buffer_end(cmd_buf);
-    swapchain_present(&swapchain, &cmd_bufs);
+    profile_zone_end(&record);
+
+    zone = profile_zone_begin("present");
+    swapchain_present(&swapchain, frame);
+    profile_zone_end(&zone);
+
+    profile_zone_end(&frame_zone);
+
+    frames_end(&frames);
+    trace_frame_end(&trace, frames.number - 1, 0);
   }
 
   vkDeviceWaitIdle(ldevice.handle);
+  trace_frame_end(&trace, frames.number, 1);
+
+  if (record_camera) {
+    fclose(record_camera);
+  }
 
   vkDestroyDescriptorPool(ldevice.handle, imgui_desc_pool, 0);
 
-  model_free(&model, &ldevice);
+  models_free(&models, &ldevice);
+  model_instances_free(&instances, &ldevice);
   diffuse_textures_free(&diffuse_textures, &ldevice);
   materials_free(&materials, &ldevice);
   postprocess_destroy(&postprocess, &ldevice);
   pbr_renderer_destroy(&pbr_renderer, &ldevice);
-  command_buffers_free(&cmd_bufs, &ldevice, cmd_pool);
+  gpu_profiler_destroy(&profiler, &ldevice);
+  frames_destroy(&frames, &ldevice);
   frame_buffers_destroy(&frame_buffers, &ldevice);
   render_pass_destroy(present_render_pass, &ldevice);
   image_destroy(&depth_image, &ldevice);
   swapchain_destroy(&swapchain);
+  uploader_destroy(&uploader);
   command_pool_destroy(cmd_pool, &ldevice);
+  pipeline_cache_destroy(&ldevice, pdevice, PIPELINE_CACHE_PATH);
   logical_device_destroy(&ldevice);
   surface_destroy(surface, instance);
   vulkan_instance_destroy(instance);
@@ -47,3 +47,73 @@ mat4_lookat(Vec3 eye, Vec3 center, Vec3 up)
 
   return out;
 }
+
+Mat4
+mat4_translation(Vec3 v)
+{
+  Mat4 out = mat4_identity();
+  out.m30  = v.x;
+  out.m31  = v.y;
+  out.m32  = v.z;
+
+  return out;
+}
+
+Mat4
+mat4_transpose(Mat4 m)
+{
+  Mat4 out;
+  for (S32 c = 0; c < 4; ++c) {
+    for (S32 r = 0; r < 4; ++r) {
+      out.m[c * 4 + r] = m.m[r * 4 + c];
+    }
+  }
+
+  return out;
+}
+
+// 2x2 sub determinants of the upper and lower halves, returns the identity if m is singular
+Mat4
+mat4_inverse(Mat4 m)
+{
+  F32 s0 = m.m00 * m.m11 - m.m10 * m.m01;
+  F32 s1 = m.m00 * m.m12 - m.m10 * m.m02;
+  F32 s2 = m.m00 * m.m13 - m.m10 * m.m03;
+  F32 s3 = m.m01 * m.m12 - m.m11 * m.m02;
+  F32 s4 = m.m01 * m.m13 - m.m11 * m.m03;
+  F32 s5 = m.m02 * m.m13 - m.m12 * m.m03;
+
+  F32 c5 = m.m22 * m.m33 - m.m32 * m.m23;
+  F32 c4 = m.m21 * m.m33 - m.m31 * m.m23;
+  F32 c3 = m.m21 * m.m32 - m.m31 * m.m22;
+  F32 c2 = m.m20 * m.m33 - m.m30 * m.m23;
+  F32 c1 = m.m20 * m.m32 - m.m30 * m.m22;
+  F32 c0 = m.m20 * m.m31 - m.m30 * m.m21;
+
+  F32 det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+  if (det == 0.0f) {
+    return mat4_identity();
+  }
+
+  F32 inv_det = 1.0f / det;
+
+  Mat4 out;
+  out.m00 = (m.m11 * c5 - m.m12 * c4 + m.m13 * c3) * inv_det;
+  out.m01 = (-m.m01 * c5 + m.m02 * c4 - m.m03 * c3) * inv_det;
+  out.m02 = (m.m31 * s5 - m.m32 * s4 + m.m33 * s3) * inv_det;
+  out.m03 = (-m.m21 * s5 + m.m22 * s4 - m.m23 * s3) * inv_det;
+  out.m10 = (-m.m10 * c5 + m.m12 * c2 - m.m13 * c1) * inv_det;
+  out.m11 = (m.m00 * c5 - m.m02 * c2 + m.m03 * c1) * inv_det;
+  out.m12 = (-m.m30 * s5 + m.m32 * s2 - m.m33 * s1) * inv_det;
+  out.m13 = (m.m20 * s5 - m.m22 * s2 + m.m23 * s1) * inv_det;
+  out.m20 = (m.m10 * c4 - m.m11 * c2 + m.m13 * c0) * inv_det;
+  out.m21 = (-m.m00 * c4 + m.m01 * c2 - m.m03 * c0) * inv_det;
+  out.m22 = (m.m30 * s4 - m.m31 * s2 + m.m33 * s0) * inv_det;
+  out.m23 = (-m.m20 * s4 + m.m21 * s2 - m.m23 * s0) * inv_det;
+  out.m30 = (-m.m10 * c3 + m.m11 * c1 - m.m12 * c0) * inv_det;
+  out.m31 = (m.m00 * c3 - m.m01 * c1 + m.m02 * c0) * inv_det;
+  out.m32 = (-m.m30 * s3 + m.m31 * s1 - m.m32 * s0) * inv_det;
+  out.m33 = (m.m20 * s3 - m.m21 * s1 + m.m22 * s0) * inv_det;
+
+  return out;
+}
@@ -64,5 +64,8 @@ Vec4 vec4(F32 x, F32 y, F32 z, F32 w);
 Mat4 mat4_identity(void);
 Mat4 mat4_perspective(F32 fov, F32 aspect, F32 near, F32 far);
 Mat4 mat4_lookat(Vec3 eye, Vec3 center, Vec3 up);
+Mat4 mat4_translation(Vec3 v);
+Mat4 mat4_transpose(Mat4 m);
+Mat4 mat4_inverse(Mat4 m);
 
 C_LINKAGE_END
@@ -1,15 +1,23 @@
 #include "models.h"
 
+#include "base/base_profile.h"
+
 #include "stb_image.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#define DIFFUSE_TEXTURES_PATH_RESERVE_SIZE MB(16)
+
 void
 diffuse_textures_init(DiffuseTextures *textures)
 {
-  *textures = (DiffuseTextures){.textures = 0, .count = 0, .capacity = 1};
+  *textures       = (DiffuseTextures){.textures = 0, .paths = 0, .path_hashes = 0, .count = 0, .capacity = 1};
+  textures->arena = arena_alloc(DIFFUSE_TEXTURES_PATH_RESERVE_SIZE);
 }
 
-void
-diffuse_textures_add(DiffuseTextures *textures, Texture texture)
+static U32
+diffuse_textures_push(DiffuseTextures *textures, Texture texture, const char *path, U64 path_hash)
 {
   Assert(textures->count < max_U32);
 
@@ -17,34 +25,247 @@ diffuse_textures_add(DiffuseTextures *textures, Texture texture)
     Assert(textures->capacity < max_U32 / 2);
     textures->capacity *= 2;
 
-    textures->textures = (Texture *)realloc(textures->textures, textures->capacity * sizeof(Texture));
+    textures->textures    = (Texture *)realloc(textures->textures, textures->capacity * sizeof(Texture));
+    textures->paths       = (const char **)realloc(textures->paths, textures->capacity * sizeof(const char *));
+    textures->path_hashes = (U64 *)realloc(textures->path_hashes, textures->capacity * sizeof(U64));
   }
 
-  textures->textures[textures->count] = texture;
+  textures->textures[textures->count]    = texture;
+  textures->paths[textures->count]       = path;
+  textures->path_hashes[textures->count] = path_hash;
   textures->count++;
+
+  return textures->count - 1;
+}
+
+U32
+diffuse_textures_add(DiffuseTextures *textures, Texture texture)
+{
+  return diffuse_textures_push(textures, texture, 0, 0);
+}
+
+typedef struct TextureDecodeJob   TextureDecodeJob;
+typedef struct TextureDecodeQueue TextureDecodeQueue;
+
+struct TextureDecodeJob {
+  const char  *path;
+  U32          kind;
+  U32          index; // texture slot reserved for the result
+  S32          width;
+  S32          height;
+  U8          *pixels;
+  TextureCache cache; // mapped levels of a cooked or KTX2 texture, pixels are null then
+  U32          done;  // set by the worker once pixels or cache are valid
+};
+
+struct TextureDecodeQueue {
+  TextureDecodeJob *jobs;
+  U32               job_count;
+  U32               next;
+  B32               compressed; // the device samples BC formats, so textures are cooked and loaded from the caches
+};
+
+static B32
+texture_path_is_ktx2(const char *path)
+{
+  U64 length = strlen(path);
+  return length >= 5 && strcmp(path + length - 5, ".ktx2") == 0;
+}
+
+static void
+texture_decode_worker(void *param)
+{
+  TextureDecodeQueue *queue = (TextureDecodeQueue *)param;
+
+  for (;;) {
+    U32 i = atomic_u32_inc_eval(&queue->next) - 1;
+    if (i >= queue->job_count) {
+      break;
+    }
+
+    TextureDecodeJob *job  = &queue->jobs[i];
+    ProfileZone       zone = profile_zone_begin("texture_decode");
+
+    // KTX2 files are already cooked, their levels are uploaded as stored
+    if (texture_path_is_ktx2(job->path)) {
+      texture_cache_load_ktx2(&job->cache, job->path);
+
+      profile_zone_end(&zone);
+      atomic_u32_eval_assign(&job->done, 1);
+      continue;
+    }
+
+    B32 cached = queue->compressed && texture_cache_load(&job->cache, job->path, job->kind);
+
+    if (!cached) {
+      S32 channels;
+      job->pixels = stbi_load(job->path, &job->width, &job->height, &channels, STBI_rgb_alpha);
+
+      // cooked once, from then on the blocks are mapped directly. If the cache can't be written the pixels are used.
+      if (job->pixels && queue->compressed) {
+        texture_cache_write(job->path, job->kind, job->pixels, job->width, job->height);
+
+        if (texture_cache_load(&job->cache, job->path, job->kind)) {
+          stbi_image_free(job->pixels);
+          job->pixels = 0;
+        }
+      }
+    }
+
+    profile_zone_end(&zone);
+    atomic_u32_eval_assign(&job->done, 1);
+  }
+}
+
+// KTX2 files can hold any format, the cooked caches are only used when BC is supported
+static B32
+diffuse_textures_format_supported(VkPhysicalDevice pdevice, Device *ldevice, VkFormat format)
+{
+  if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK && !ldevice->texture_compression_bc) {
+    return 0;
+  }
+
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(pdevice, format, &properties);
+
+  return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
 }
 
+static S32
+diffuse_textures_find(DiffuseTextures *textures, const char *path, U64 path_hash)
+{
+  for (U32 i = 0; i < textures->count; ++i) {
+    if (textures->path_hashes[i] == path_hash && textures->paths[i] && strcmp(textures->paths[i], path) == 0) {
+      return (S32)i;
+    }
+  }
+
+  return -1;
+}
+
+// Decodes every texture that is not loaded yet on worker threads, the calling thread uploads them in whatever order they finish.
+// indices receives the texture index of every path, kinds is a TEXTURE_KIND_* per path.
+// KTX2 files (by extension) skip decoding, their format and mips are used as stored and the kind only keys the dedup.
 void
-diffuse_textures_add_from_path(DiffuseTextures *textures, const char *path, VkPhysicalDevice pdevice, Device *ldevice,
-                               VkCommandPool cmd_pool)
+diffuse_textures_add_from_paths(DiffuseTextures *textures, const char **paths, U32 *kinds, U32 count, U32 *indices,
+                                VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader)
 {
+  ProfileZone zone  = profile_zone_begin("texture_load");
+  U64         begin = os_now_microseconds();
+
+  Temp scratch = scratch_begin(0, 0);
+
+  TextureDecodeQueue queue = {0};
+  queue.jobs               = push_array(scratch.arena, TextureDecodeJob, count);
+  queue.compressed         = ldevice->texture_compression_bc;
+
+  // slots are reserved in path order, so the indices do not depend on which decode finishes first
+  for (U32 i = 0; i < count; ++i) {
+    // the kind is part of the key, the same file can be loaded once for each
+    U64 path_size = strlen(paths[i]) + 1;
+    U64 path_hash = hash_fnv1a(paths[i], path_size - 1) ^ kinds[i];
+
+    S32 existing = diffuse_textures_find(textures, paths[i], path_hash);
+    if (existing >= 0) {
+      indices[i] = (U32)existing;
+      continue;
+    }
+
+    char *interned = push_array_no_zero(textures->arena, char, path_size);
+    MemoryCopy(interned, paths[i], path_size);
+
+    Texture placeholder = {0};
+    indices[i]          = diffuse_textures_push(textures, placeholder, interned, path_hash);
+
+    TextureDecodeJob *job = &queue.jobs[queue.job_count++];
+    job->path             = interned;
+    job->kind             = kinds[i];
+    job->index            = indices[i];
+  }
+
+  U32     thread_count = Min(os_processor_count(), queue.job_count);
+  Thread *threads      = push_array(scratch.arena, Thread, thread_count);
+  for (U32 i = 0; i < thread_count; ++i) {
+    threads[i] = os_thread_launch(texture_decode_worker, &queue);
+  }
+
   VkSamplerCreateInfo sampler_info = {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
   sampler_info.minFilter           = VK_FILTER_LINEAR;
   sampler_info.magFilter           = VK_FILTER_LINEAR;
   sampler_info.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-  sampler_info.maxLod              = 1.0f;
+  sampler_info.maxLod              = VK_LOD_CLAMP_NONE;
+
+  // the uploader is not thread safe, so only this thread touches it
+  U64 uploaded_bytes   = 0;
+  U32 cooked_count     = 0;
+  U32 uploaded         = 0;
+  B8 *is_uploaded      = push_array(scratch.arena, B8, queue.job_count);
+
+  while (uploaded < queue.job_count) {
+    B32 progress = 0;
+
+    for (U32 i = 0; i < queue.job_count; ++i) {
+      TextureDecodeJob *job = &queue.jobs[i];
+      if (is_uploaded[i] || !atomic_u32_eval(&job->done)) {
+        continue;
+      }
+
+      TextureCache *cache = &job->cache;
+
+      if (cache->data) {
+        if (!diffuse_textures_format_supported(pdevice, ldevice, cache->format)) {
+          log_fatal("Texture format %u is not supported by the device: %s", cache->format, job->path);
+        }
+
+        textures->textures[job->index] = texture_from_levels(cache->width, cache->height, cache->mip_levels, cache->format, cache->data,
+                                                             cache->size, cache->level_offsets, sampler_info, pdevice, ldevice, uploader);
+
+        uploaded_bytes += cache->size;
+        cooked_count++;
+        texture_cache_free(cache);
+      } else if (job->pixels) {
+        VkFormat format = job->kind == TEXTURE_KIND_COLOR ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+
+        textures->textures[job->index] =
+            texture_from_pixels(job->width, job->height, STBI_rgb_alpha, format, job->pixels, sampler_info, pdevice, ldevice, uploader);
+        stbi_image_free(job->pixels);
 
-  VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+        uploaded_bytes += (U64)job->width * job->height * STBI_rgb_alpha;
+      } else {
+        log_fatal("Failed to load texture: %s", job->path);
+      }
 
-  S32 width, height, channels;
-  U8 *pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
-  if (!pixels) {
-    log_fatal("Failed to load texture: %s", path);
+      is_uploaded[i] = 1;
+      uploaded++;
+      progress = 1;
+    }
+
+    if (!progress) {
+      os_sleep_milliseconds(1);
+    }
+  }
+
+  for (U32 i = 0; i < thread_count; ++i) {
+    os_thread_join(threads[i]);
+  }
+
+  if (queue.job_count > 0) {
+    F64 load_ms = (F64)(os_now_microseconds() - begin) / 1000.0;
+    log_dev("Loaded %u textures (%u cooked, %.1f MB uploaded) on %u threads in %.2f ms", queue.job_count, cooked_count,
+            (F64)uploaded_bytes / (F64)MB(1), thread_count, load_ms);
   }
 
-  Texture t = texture_from_pixels(width, height, STBI_rgb_alpha, format, pixels, sampler_info, pdevice, ldevice, cmd_pool);
+  scratch_end(scratch);
+  profile_zone_end(&zone);
+}
 
-  diffuse_textures_add(textures, t);
+U32
+diffuse_textures_add_from_path(DiffuseTextures *textures, const char *path, U32 kind, VkPhysicalDevice pdevice, Device *ldevice,
+                               Uploader *uploader)
+{
+  U32 index;
+  diffuse_textures_add_from_paths(textures, &path, &kind, 1, &index, pdevice, ldevice, uploader);
+  return index;
 }
 
 void
@@ -55,4 +276,37 @@ diffuse_textures_free(DiffuseTextures *textures, Device *ldevice)
   }
 
   free(textures->textures);
+  free(textures->paths);
+  free(textures->path_hashes);
+  arena_release(textures->arena);
+}
+
+// Fills the bindless array of PBRRenderer.texture_set, the set is update after bind so this is fine while it is in use.
+// The set has to be created for all of the textures, pbr_renderer_create stops when they don't fit.
+void
+diffuse_textures_write_descriptors(DiffuseTextures *textures, Device *ldevice, DescriptorSet *desc_set)
+{
+  if (textures->count == 0) {
+    return;
+  }
+
+  Assert(textures->count <= PBR_TEXTURE_MAX);
+
+  Temp scratch = scratch_begin(0, 0);
+
+  VkDescriptorImageInfo *image_infos = push_array_no_zero(scratch.arena, VkDescriptorImageInfo, textures->count);
+  for (U32 i = 0; i < textures->count; i++) {
+    image_infos[i] = textures->textures[i].descriptor;
+  }
+
+  VkWriteDescriptorSet desc_write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  desc_write.dstSet               = desc_set->handle;
+  desc_write.dstBinding           = 0;
+  desc_write.descriptorCount      = textures->count;
+  desc_write.descriptorType       = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  desc_write.pImageInfo           = image_infos;
+
+  vkUpdateDescriptorSets(ldevice->handle, 1, &desc_write, 0, 0);
+
+  scratch_end(scratch);
 }
@@ -1,130 +1,282 @@
 #include "models.h"
+#include "obj_parser.h"
 
+#include "base/base_arena.h"
+#include "base/base_profile.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include <unordered_map>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+// Vertex has no padding, so two vertices are the same if their bytes are the same
+struct VertexHash {
+  size_t
+  operator()(const Vertex &v) const
+  {
+    return (size_t)hash_fnv1a(&v, sizeof(Vertex));
+  }
+};
 
-ModelDescriptor
-model_load(VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool, Model *m, Materials *materials,
-           DiffuseTextures *diffuse_textures, const char *path)
+struct VertexEqual {
+  bool
+  operator()(const Vertex &a, const Vertex &b) const
+  {
+    return memcmp(&a, &b, sizeof(Vertex)) == 0;
+  }
+};
+
+struct ObjMesh {
+  Vertex *vertices;
+  U32     vertex_count;
+  U32    *indices;
+  U32     index_count;
+  S32    *material_ids;
+  U32     material_id_count;
+
+  MeshMaterial *materials;
+  U32           material_count;
+  const char  **source_paths; // mtl libraries, only known when the obj was parsed
+  U32           source_count;
+};
+
+// Reads the pbr extension of the mtl format (Pr, Pm, map_Pr, map_Pm, norm) on top of Kd, Ks and map_Kd.
+// Texture paths are resolved relative to the obj and loaded when the model is loaded.
+static void
+obj_material_cook(MeshMaterial *dst, const tinyobj::material_t &src, const std::string &directory)
 {
-  U32     vertex_count         = 0;
-  Vertex *vertices             = 0;
-  U32     index_count          = 0;
-  U32    *indices              = 0;
-  U32     material_index_count = 0;
-  U32    *material_indices     = 0;
-
-  tinyobj::ObjReader reader;
-  reader.ParseFromFile(path);
-
-  const tinyobj::attrib_t &attrib = reader.GetAttrib();
-
-  // because we store all materials in a single array, local material index have to be mapped to global material index
-  std::unordered_map<S32, U32> mat_index_map = {};
-  mat_index_map.insert({-1, 0}); // means that if no material, then use default material
-
-  /* We don't load material anymore because we load wavefront object files and they don't store information for pbr materials like
-  roughness, so until we use some other loader and other format like assimp and glTF, we have to just load the vertex information and set
-  the materials manually U32 mat_index = 0; for (const auto &obj_mat : reader.GetMaterials()) { U32 existing_index =
-  materials_get_index(materials, obj_mat.name.c_str()); if (existing_index != UINT32_MAX) { mat_index_map[mat_index] = existing_index;
-          mat_index++;
-          continue;
-      }
+  MemoryZero(dst, sizeof(MeshMaterial));
+  snprintf(dst->name, sizeof(dst->name), "%s", src.name.c_str());
 
-      Material mat = {};
-
-      mat.ambient       = vec4(obj_mat.ambient[0], obj_mat.ambient[1], obj_mat.ambient[2], 1.0f);
-      mat.diffuse       = vec4(obj_mat.diffuse[0], obj_mat.diffuse[1], obj_mat.diffuse[2], 1.0f);
-      mat.specular      = vec4(obj_mat.specular[0], obj_mat.specular[1], obj_mat.specular[2], 1.0f);
-      mat.transmittance = vec4(obj_mat.transmittance[0], obj_mat.transmittance[1], obj_mat.transmittance[2], 1.0f);
-      mat.emission      = vec4(obj_mat.emission[0], obj_mat.emission[1], obj_mat.emission[2], 1.0f);
-      mat.shininess     = obj_mat.shininess;
-      mat.ior           = obj_mat.ior;
-      mat.dissolve      = obj_mat.dissolve;
-      mat.illum         = obj_mat.illum;
-
-      if (!obj_mat.diffuse_texname.empty()) {
-          std::string tex_path = "assets/models/" + obj_mat.diffuse_texname;
-          log_dev("Loading texture: %s", tex_path.c_str());
-          diffuse_textures_add_from_path(diffuse_textures, tex_path.c_str(), pdevice, ldevice, cmd_pool);
-
-          // mat.texture_offset = diffuse_textures->count;
-      } else {
-          // mat.texture_offset = -1;
-      }
+  Material *m  = &dst->material;
+  m->albedo    = vec4(src.diffuse[0], src.diffuse[1], src.diffuse[2], src.dissolve);
+  m->metallic  = Clamp(0.0f, src.metallic, 1.0f);
+  m->specular  = Clamp(0.0f, (src.specular[0] + src.specular[1] + src.specular[2]) / 3.0f, 1.0f);
+  m->roughness = Clamp(0.0f, src.roughness, 1.0f);
 
-      U32 index_of_added = materials_add(materials, obj_mat.name.c_str(), mat);
+  // tinyobj leaves Pr at 0 when it is missing, then the blinn phong exponent is the best guess
+  if (src.roughness == 0.0f && src.roughness_texname.empty()) {
+    m->roughness = sqrtf(2.0f / (Max(src.shininess, 0.0f) + 2.0f));
+  }
 
-      mat_index_map[mat_index] = index_of_added;
+  const std::string *textures[MATERIAL_TEXTURE_COUNT] = {};
+  textures[MATERIAL_TEXTURE_ALBEDO]                   = &src.diffuse_texname;
+  textures[MATERIAL_TEXTURE_ROUGHNESS]                = &src.roughness_texname;
+  textures[MATERIAL_TEXTURE_METALLIC]                 = &src.metallic_texname;
+  textures[MATERIAL_TEXTURE_NORMAL]                   = &src.normal_texname;
 
-      mat_index++;
-  }*/
+  for (U32 i = 0; i < MATERIAL_TEXTURE_COUNT; i++) {
+    m->textures[i] = -1;
+    if (textures[i]->empty()) {
+      continue;
+    }
 
-  // map every material to the default material for now
-  U32 mat_index = 0;
-  for (const auto &obj_mat : reader.GetMaterials()) {
-    mat_index_map[mat_index] = 0;
+    std::string path = obj_join_path(directory, *textures[i]);
+    if (path.size() >= MESH_PATH_MAX) {
+      log_dev("Ignoring texture with a too long path: %s", path.c_str());
+      continue;
+    }
 
-    mat_index++;
+    MemoryCopy(dst->textures[i], path.c_str(), path.size() + 1);
   }
+}
 
-  for (const auto &shape : reader.GetShapes()) {
-    vertices         = (Vertex *)realloc(vertices, (shape.mesh.indices.size() + vertex_count) * sizeof(Vertex));
-    indices          = (U32 *)realloc(indices, (shape.mesh.indices.size() + index_count) * sizeof(U32));
-    material_indices = (U32 *)realloc(material_indices, (shape.mesh.material_ids.size() + material_index_count) * sizeof(U32));
+// returns 0 if the obj could not be read, the mesh is left empty then
+static B32
+obj_mesh_parse(Arena *arena, ObjMesh *mesh, const char *path)
+{
+  ObjFile obj = {};
+  if (!obj_file_parse(&obj, path)) {
+    return 0;
+  }
 
-    for (U32 i = 0; i < shape.mesh.material_ids.size(); i++) {
-      material_indices[material_index_count + i] = mat_index_map[shape.mesh.material_ids[i]];
+  const tinyobj::attrib_t &attrib = obj.attrib;
+
+  mesh->material_count = obj.materials.size();
+  mesh->materials      = push_array(arena, MeshMaterial, mesh->material_count);
+  for (U32 i = 0; i < mesh->material_count; i++) {
+    obj_material_cook(&mesh->materials[i], obj.materials[i], obj.directory);
+  }
+
+  mesh->source_count = obj.mtl_paths.size();
+  mesh->source_paths = push_array(arena, const char *, mesh->source_count);
+  for (U32 i = 0; i < mesh->source_count; i++) {
+    U64   size = obj.mtl_paths[i].size() + 1;
+    char *copy = push_array_no_zero(arena, char, size);
+    MemoryCopy(copy, obj.mtl_paths[i].c_str(), size);
+    mesh->source_paths[i] = copy;
+  }
+
+  // vertices are welded across all shapes, so a vertex shared by two shapes is only stored once
+  U32 total_index_count       = obj.indices.size();
+  U32 total_material_id_count = obj.material_ids.size();
+
+  std::unordered_map<Vertex, U32, VertexHash, VertexEqual> vertex_map = {};
+  vertex_map.reserve(total_index_count);
+
+  mesh->vertices     = push_array_no_zero(arena, Vertex, total_index_count);
+  mesh->indices      = push_array_no_zero(arena, U32, total_index_count);
+  mesh->material_ids = push_array_no_zero(arena, S32, total_material_id_count);
+
+  for (U32 i = 0; i < total_material_id_count; i++) {
+    mesh->material_ids[mesh->material_id_count++] = obj.material_ids[i];
+  }
+
+  for (const auto &index : obj.indices) {
+    Vertex       vertex = {};
+    const float *vp     = &attrib.vertices[3 * index.vertex_index];
+    vertex.position     = {*(vp + 0), *(vp + 1), *(vp + 2)};
+
+    if (!attrib.normals.empty() && index.normal_index >= 0) {
+      const float *np = &attrib.normals[3 * index.normal_index];
+      vertex.normal   = {*(np + 0), *(np + 1), *(np + 2)};
     }
 
-    U32 vertex_index  = vertex_count;
-    U32 indices_index = index_count;
-    for (const auto &index : shape.mesh.indices) {
-      Vertex       vertex = {};
-      const float *vp     = &attrib.vertices[3 * index.vertex_index];
-      vertex.position     = {*(vp + 0), *(vp + 1), *(vp + 2)};
+    if (!attrib.texcoords.empty() && index.texcoord_index >= 0) {
+      const float *tp   = &attrib.texcoords[2 * index.texcoord_index + 0];
+      vertex.tex_coords = {*tp, 1.0f - *(tp + 1)};
+    }
+
+    auto [it, inserted] = vertex_map.try_emplace(vertex, mesh->vertex_count);
+    if (inserted) {
+      mesh->vertices[mesh->vertex_count++] = vertex;
+    }
 
-      if (!attrib.normals.empty() && index.normal_index >= 0) {
-        const float *np = &attrib.normals[3 * index.normal_index];
-        vertex.normal   = {*(np + 0), *(np + 1), *(np + 2)};
+    mesh->indices[mesh->index_count++] = it->second;
+  }
+
+  return 1;
+}
+
+// returns the index of the model in models
+U32
+model_load(VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader, Models *models, Materials *materials,
+           DiffuseTextures *diffuse_textures, const char *path)
+{
+  ProfileScoped("model_load");
+
+  U64  load_start = os_now_microseconds();
+  Temp scratch    = scratch_begin(0, 0);
+
+  // the cooked mesh is used as is, otherwise parse the obj and cook it for the next run
+  ObjMesh   mesh   = {};
+  MeshCache cache  = {};
+  B32       cached = mesh_cache_load(&cache, path);
+  if (cached) {
+    mesh.vertices           = cache.vertices;
+    mesh.vertex_count       = cache.vertex_count;
+    mesh.indices            = cache.indices;
+    mesh.index_count        = cache.index_count;
+    mesh.material_ids       = cache.material_ids;
+    mesh.material_id_count  = cache.material_id_count;
+    mesh.materials          = cache.materials;
+    mesh.material_count     = cache.material_count;
+  } else {
+    // an empty cache would stay valid as long as the obj is unchanged, so nothing is cooked from a failed parse
+    if (!obj_mesh_parse(scratch.arena, &mesh, path)) {
+      log_fatal("Failed to load model: %s", path);
+    }
+
+    mesh_cache_write(path, mesh.vertices, mesh.vertex_count, mesh.indices, mesh.index_count, mesh.material_ids, mesh.material_id_count,
+                     mesh.materials, mesh.material_count, mesh.source_paths, mesh.source_count);
+  }
+
+  // because we store all materials in a single array, local material index have to be mapped to global material index.
+  // slot 0 is obj material -1, which means no material and uses the default material
+  U32  mat_index_map_count = mesh.material_count + 1;
+  U32 *mat_index_map       = push_array(scratch.arena, U32, mat_index_map_count);
+
+  // all textures of the model are decoded together, so they are spread over every core
+  U32          texture_count_max = mesh.material_count * MATERIAL_TEXTURE_COUNT;
+  const char **texture_paths     = push_array(scratch.arena, const char *, texture_count_max);
+  U32         *texture_kinds     = push_array(scratch.arena, U32, texture_count_max);
+  U32         *texture_indices   = push_array(scratch.arena, U32, texture_count_max);
+  S32         *texture_refs      = push_array(scratch.arena, S32, texture_count_max); // per material slot, -1 if unused
+  U32          texture_count     = 0;
+
+  for (U32 mat_index = 0; mat_index < mesh.material_count; mat_index++) {
+    MeshMaterial *src = &mesh.materials[mat_index];
+
+    for (U32 t = 0; t < MATERIAL_TEXTURE_COUNT; t++) {
+      S32 *ref = &texture_refs[mat_index * MATERIAL_TEXTURE_COUNT + t];
+      *ref     = -1;
+
+      if (!src->textures[t][0]) {
+        continue;
+      }
+
+      if (!os_file_properties(src->textures[t]).exists) {
+        log_dev("Missing texture %s of material %s", src->textures[t], src->name);
+        continue;
       }
 
-      if (!attrib.texcoords.empty() && index.texcoord_index >= 0) {
-        const float *tp   = &attrib.texcoords[2 * index.texcoord_index + 0];
-        vertex.tex_coords = {*tp, 1.0f - *(tp + 1)};
+      // only albedo is a color, roughness and metallic only use one channel
+      U32 kind = TEXTURE_KIND_SCALAR;
+      if (t == MATERIAL_TEXTURE_ALBEDO) {
+        kind = TEXTURE_KIND_COLOR;
+      } else if (t == MATERIAL_TEXTURE_NORMAL) {
+        kind = TEXTURE_KIND_NORMAL;
       }
 
-      vertices[vertex_index++] = vertex;
-      indices[indices_index++] = indices_index;
+      *ref                         = (S32)texture_count;
+      texture_paths[texture_count] = src->textures[t];
+      texture_kinds[texture_count] = kind;
+      texture_count++;
+    }
+  }
+
+  diffuse_textures_add_from_paths(diffuse_textures, texture_paths, texture_kinds, texture_count, texture_indices, pdevice, ldevice,
+                                  uploader);
+
+  for (U32 mat_index = 0; mat_index < mesh.material_count; mat_index++) {
+    MeshMaterial *src = &mesh.materials[mat_index];
+    Material      mat = src->material;
+
+    for (U32 t = 0; t < MATERIAL_TEXTURE_COUNT; t++) {
+      S32 ref = texture_refs[mat_index * MATERIAL_TEXTURE_COUNT + t];
+      if (ref >= 0) {
+        mat.textures[t] = (S32)texture_indices[ref];
+      }
     }
 
-    vertex_count += shape.mesh.indices.size();
-    index_count += shape.mesh.indices.size();
-    material_index_count += shape.mesh.material_ids.size();
+    // identical materials are shared, within the model and with every model loaded before
+    mat_index_map[mat_index + 1] = materials_add(materials, src->name, mat);
   }
 
-  m->vertex_buffer =
-      buffer_create(vertex_count * sizeof(Vertex), (void *)vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, pdevice, ldevice, cmd_pool);
-  m->index_buffer = buffer_create(index_count * sizeof(U32), (void *)indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, pdevice, ldevice, cmd_pool);
-  m->material_index_buffer =
-      buffer_create(material_index_count * sizeof(U32), (void *)material_indices,
-                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, pdevice, ldevice, cmd_pool);
-  m->index_count = index_count;
+  U32 vertex_count         = mesh.vertex_count;
+  U32 index_count          = mesh.index_count;
+  U32 material_index_count = mesh.material_id_count;
 
-  free(vertices);
-  free(indices);
-  free(material_indices);
+  // the geometry is appended to the shared arrays, it goes to the gpu with every other model in models_write_descriptors
+  Model *m = models_push(models, vertex_count, index_count, material_index_count);
 
-  ModelDescriptor descriptor = {};
+  MemoryCopy(models->vertices + m->vertex_offset, mesh.vertices, (U64)vertex_count * sizeof(Vertex));
+  MemoryCopy(models->indices + m->first_index, mesh.indices, (U64)index_count * sizeof(U32));
 
-  VkBufferDeviceAddressInfo address_info = {VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR};
-  address_info.buffer                    = m->material_index_buffer.handle;
+  U32 *material_indices = models->material_indices + m->first_material_index;
+  for (U32 i = 0; i < material_index_count; i++) {
+    U32 slot            = (U32)(mesh.material_ids[i] + 1);
+    material_indices[i] = slot < mat_index_map_count ? mat_index_map[slot] : 0;
+  }
 
-  descriptor.material_index_buffer_address = vkGetBufferDeviceAddress(ldevice->handle, &address_info);
+  // instances of the model are laid out with the bounds
+  m->bounds_min = vertex_count ? mesh.vertices[0].position : vec3(0.0f, 0.0f, 0.0f);
+  m->bounds_max = m->bounds_min;
+  for (U32 i = 1; i < vertex_count; i++) {
+    Vec3 p        = mesh.vertices[i].position;
+    m->bounds_min = vec3(Min(m->bounds_min.x, p.x), Min(m->bounds_min.y, p.y), Min(m->bounds_min.z, p.z));
+    m->bounds_max = vec3(Max(m->bounds_max.x, p.x), Max(m->bounds_max.y, p.y), Max(m->bounds_max.z, p.z));
+  }
+
+  if (cached) {
+    mesh_cache_free(&cache);
+  }
+  scratch_end(scratch);
 
-  log_dev("Model loaded: %s with %u vertices and %u indices", path, vertex_count, index_count);
+  F32 load_ms     = (F32)(os_now_microseconds() - load_start) / 1000.0f;
+  F32 dedup_ratio = vertex_count ? (F32)index_count / (F32)vertex_count : 0.0f;
+  log_dev("Model loaded: %s with %u vertices and %u indices (dedup ratio %.2fx) in %.2f ms (%s)", path, vertex_count, index_count,
+          dedup_ratio, load_ms, cached ? "warm, mesh cache" : "cold, parsed obj");
 
-  return descriptor;
+  return m->index;
 }
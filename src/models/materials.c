@@ -2,54 +2,185 @@
 
 #include <string.h>
 
+#define MATERIALS_NAME_RESERVE_SIZE MB(16)
+
 void
 materials_init(Materials *materials)
 {
-  *materials = (Materials){.names = 0, .materials = 0, .count = 0, .capacity = 1, .buffer = {0}};
+  MemoryZero(materials, sizeof(Materials));
+  materials->capacity      = 1;
+  materials->name_capacity = 1;
+  materials->arena         = arena_alloc(MATERIALS_NAME_RESERVE_SIZE);
 
   materials_add(materials, "default",
-                (Material){.albedo = vec4(0.123f, 0.0f, 0.754f, 1.0f), .metallic = 0.0f, .specular = 0.0f, .roughness = 0.0f});
+                (Material){.albedo    = vec4(0.123f, 0.0f, 0.754f, 1.0f),
+                           .metallic  = 0.0f,
+                           .specular  = 0.0f,
+                           .roughness = 0.0f,
+                           .textures  = {-1, -1, -1, -1}});
+}
+
+static U64
+materials_hash(const char *name)
+{
+  return hash_fnv1a(name, strlen(name));
+}
+
+// materials are compared bytewise, the padding is always zero
+static U64
+materials_content_hash(Material *mat)
+{
+  return hash_fnv1a(mat, sizeof(Material));
+}
+
+static void
+materials_slot_insert(U32 *slots, U32 slot_count, U64 hash, U32 index)
+{
+  U32 mask = slot_count - 1;
+  U32 slot = (U32)hash & mask;
+
+  while (slots[slot]) {
+    slot = (slot + 1) & mask;
+  }
+
+  slots[slot] = index + 1;
+}
+
+// Grows the table when count entries would fill more than half of it. The entries before the last one are
+// reinserted, the caller inserts the last.
+static U32 *
+materials_slots_reserve(U32 *slots, U32 *slot_count, U64 *hashes, U32 count)
+{
+  if (count * 2 <= *slot_count) {
+    return slots;
+  }
+
+  free(slots);
+
+  *slot_count = *slot_count ? *slot_count * 2 : 16;
+  slots       = (U32 *)calloc(*slot_count, sizeof(U32));
+
+  for (U32 i = 0; i < count - 1; ++i) {
+    materials_slot_insert(slots, *slot_count, hashes[i], i);
+  }
+
+  return slots;
+}
+
+static U32
+materials_find(Materials *materials, Material *mat, U64 hash)
+{
+  if (materials->material_slot_count == 0) {
+    return max_U32;
+  }
+
+  U32 mask = materials->material_slot_count - 1;
+  U32 slot = (U32)hash & mask;
+
+  while (materials->material_slots[slot]) {
+    U32 index = materials->material_slots[slot] - 1;
+    if (materials->material_hashes[index] == hash && memcmp(&materials->materials[index], mat, sizeof(Material)) == 0) {
+      return index;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+
+  return max_U32;
+}
+
+static void
+materials_add_name(Materials *materials, const char *name, U32 index)
+{
+  Assert(materials->name_count < max_U32);
+
+  if (materials->name_count + 1 >= materials->name_capacity) {
+    Assert(materials->name_capacity < max_U32 / 2);
+    materials->name_capacity *= 2;
+
+    materials->names          = (const char **)realloc(materials->names, materials->name_capacity * sizeof(const char *));
+    materials->name_hashes    = (U64 *)realloc(materials->name_hashes, materials->name_capacity * sizeof(U64));
+    materials->name_materials = (U32 *)realloc(materials->name_materials, materials->name_capacity * sizeof(U32));
+  }
+
+  U64   name_size = strlen(name) + 1;
+  char *interned  = push_array_no_zero(materials->arena, char, name_size);
+  MemoryCopy(interned, name, name_size);
+
+  U32 name_index = materials->name_count++;
+
+  materials->names[name_index]          = interned;
+  materials->name_hashes[name_index]    = materials_hash(interned);
+  materials->name_materials[name_index] = index;
+
+  materials->name_slots = materials_slots_reserve(materials->name_slots, &materials->name_slot_count, materials->name_hashes,
+                                                  materials->name_count);
+  materials_slot_insert(materials->name_slots, materials->name_slot_count, materials->name_hashes[name_index], name_index);
 }
 
+// Returns the index of an identical material if there already is one, the name then refers to it as well
 U32
 materials_add(Materials *materials, const char *name, Material mat)
 {
-  Assert(materials->count < max_U32);
+  U64 hash  = materials_content_hash(&mat);
+  U32 index = materials_find(materials, &mat, hash);
+
+  if (index == max_U32) {
+    Assert(materials->count < max_U32);
+
+    if (materials->count + 1 >= materials->capacity) {
+      Assert(materials->capacity < max_U32 / 2);
+      materials->capacity *= 2;
+
+      materials->materials       = (Material *)realloc(materials->materials, materials->capacity * sizeof(Material));
+      materials->material_hashes = (U64 *)realloc(materials->material_hashes, materials->capacity * sizeof(U64));
+      materials->dirty           = (B8 *)realloc(materials->dirty, materials->capacity * sizeof(B8));
+    }
 
-  if (materials->count + 1 >= materials->capacity) {
-    Assert(materials->capacity < max_U32 / 2);
-    materials->capacity *= 2;
+    // nothing is on the gpu yet, materials_write_descriptors uploads the whole array
+    index = materials->count++;
 
-    materials->materials = (Material *)realloc(materials->materials, materials->capacity * sizeof(Material));
-    materials->names     = (const char **)realloc(materials->names, materials->capacity * sizeof(const char *));
+    materials->materials[index]       = mat;
+    materials->material_hashes[index] = hash;
+    materials->dirty[index]           = 0;
+
+    materials->material_slots = materials_slots_reserve(materials->material_slots, &materials->material_slot_count,
+                                                        materials->material_hashes, materials->count);
+    materials_slot_insert(materials->material_slots, materials->material_slot_count, hash, index);
   }
 
-  materials->materials[materials->count] = mat;
-  materials->names[materials->count]     = name;
-  materials->count++;
+  if (materials_get_index(materials, name) != index) {
+    materials_add_name(materials, name, index);
+  }
 
-  return materials->count - 1;
+  return index;
 }
 
 B8
 materials_has(Materials *materials, const char *name)
 {
-  for (U32 i = 0; i < materials->count; ++i) {
-    if (strcmp(materials->names[i], name) == 0) {
-      return 1;
-    }
-  }
-
-  return 0;
+  return materials_get_index(materials, name) != max_U32;
 }
 
+// slots are filled in order, so a name that was added twice resolves to the first material
 U32
 materials_get_index(Materials *materials, const char *name)
 {
-  for (U32 i = 0; i < materials->count; ++i) {
-    if (strcmp(materials->names[i], name) == 0) {
-      return i;
+  if (materials->name_slot_count == 0) {
+    return max_U32;
+  }
+
+  U64 hash = materials_hash(name);
+  U32 mask = materials->name_slot_count - 1;
+  U32 slot = (U32)hash & mask;
+
+  while (materials->name_slots[slot]) {
+    U32 index = materials->name_slots[slot] - 1;
+    if (materials->name_hashes[index] == hash && strcmp(materials->names[index], name) == 0) {
+      return materials->name_materials[index];
     }
+
+    slot = (slot + 1) & mask;
   }
 
   return max_U32;
@@ -59,13 +190,20 @@ void
 materials_free(Materials *materials, Device *ldevice)
 {
   free(materials->materials);
+  free(materials->material_hashes);
+  free(materials->dirty);
+  free(materials->material_slots);
   free(materials->names);
+  free(materials->name_hashes);
+  free(materials->name_materials);
+  free(materials->name_slots);
+  arena_release(materials->arena);
 
   // @Todo: destroy buffer but crashes
 }
 
 void
-materials_write_descriptors(Materials *materials, VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool,
+materials_write_descriptors(Materials *materials, VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader,
                             DescriptorSet *desc_set)
 {
   if (materials->buffer.handle != VK_NULL_HANDLE) {
@@ -74,8 +212,11 @@ materials_write_descriptors(Materials *materials, VkPhysicalDevice pdevice, Devi
 
   U32 size = materials->count * sizeof(Material);
 
-  materials->buffer = buffer_create(size, materials->materials, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                    pdevice, ldevice, cmd_pool);
+  materials->buffer = buffer_create_device(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, pdevice, ldevice);
+  uploader_upload_buffer(uploader, &materials->buffer, 0, materials->materials, size);
+
+  MemoryZero(materials->dirty, materials->count * sizeof(B8));
+  materials->dirty_count = 0;
 
   VkDescriptorBufferInfo buffer_desc = {materials->buffer.handle, 0, VK_WHOLE_SIZE};
 
@@ -90,27 +231,67 @@ materials_write_descriptors(Materials *materials, VkPhysicalDevice pdevice, Devi
 }
 
 void
-materials_update_uniforms(Materials *materials, VkCommandBuffer cmd_buf)
+materials_mark_dirty(Materials *materials, U32 index)
 {
-  VkDeviceSize size = materials->count * sizeof(Material);
+  if (!materials->dirty[index]) {
+    materials->dirty[index] = 1;
+    materials->dirty_count++;
+  }
+}
+
+// Copies runs of changed materials from the frame's staging memory, nothing is recorded if nothing changed
+void
+materials_update_uniforms(Materials *materials, Frame *frame)
+{
+  if (materials->dirty_count == 0) {
+    return;
+  }
+
+  VkBufferCopy *regions      = push_array_no_zero(frame->arena, VkBufferCopy, materials->dirty_count);
+  U32           region_count = 0;
+
+  for (U32 i = 0; i < materials->count;) {
+    if (!materials->dirty[i]) {
+      ++i;
+      continue;
+    }
+
+    U32 first = i;
+    while (i < materials->count && materials->dirty[i]) {
+      materials->dirty[i] = 0;
+      ++i;
+    }
+
+    VkDeviceSize size = (i - first) * sizeof(Material);
+    VkDeviceSize offset;
+    MemoryCopy(frame_stage(frame, size, &offset), &materials->materials[first], size);
+
+    regions[region_count++] = (VkBufferCopy){offset, first * sizeof(Material), size};
+  }
+
+  materials->dirty_count = 0;
+
+  VkCommandBuffer cmd_buf = frame->cmd_buf;
 
   VkBufferMemoryBarrier beforeBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
   beforeBarrier.srcAccessMask         = VK_ACCESS_SHADER_READ_BIT;
   beforeBarrier.dstAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
+  beforeBarrier.srcQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+  beforeBarrier.dstQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
   beforeBarrier.buffer                = materials->buffer.handle;
   beforeBarrier.offset                = 0;
-  beforeBarrier.size                  = size;
-  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_DEPENDENCY_DEVICE_GROUP_BIT, 0, 0,
-                       1, &beforeBarrier, 0, 0);
+  beforeBarrier.size                  = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 1, &beforeBarrier, 0, 0);
 
-  vkCmdUpdateBuffer(cmd_buf, materials->buffer.handle, 0, size, materials->materials);
+  vkCmdCopyBuffer(cmd_buf, frame->staging.handle, materials->buffer.handle, region_count, regions);
 
   VkBufferMemoryBarrier afterBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
   afterBarrier.srcAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
   afterBarrier.dstAccessMask         = VK_ACCESS_SHADER_READ_BIT;
+  afterBarrier.srcQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+  afterBarrier.dstQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
   afterBarrier.buffer                = materials->buffer.handle;
   afterBarrier.offset                = 0;
-  afterBarrier.size                  = size;
-  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_DEPENDENCY_DEVICE_GROUP_BIT, 0, 0,
-                       1, &afterBarrier, 0, 0);
-};
+  afterBarrier.size                  = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, 0, 1, &afterBarrier, 0, 0);
+}
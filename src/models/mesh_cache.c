@@ -0,0 +1,186 @@
+#include "models.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Cooked meshes are stored next to the obj as "<path>.mesh":
+//   MeshCacheHeader | MeshSource[source_count] | MeshMaterial[material_count] | Vertex[vertex_count] | U32[index_count] |
+//   S32[material_id_count]
+// Material ids are the local obj material ids, they are mapped to global materials at load time.
+// The sources are the mtl libraries, editing one of them invalidates the cache like editing the obj.
+
+#define MESH_CACHE_MAGIC   0x4853454du // "MESH"
+#define MESH_CACHE_VERSION 2
+
+typedef struct MeshCacheHeader MeshCacheHeader;
+
+struct MeshCacheHeader {
+  U32 magic;
+  U32 version;
+  U64 vertex_layout_hash;
+  U64 source_path_hash;
+  U64 source_size;
+  U64 source_modified;
+  U32 vertex_count;
+  U32 index_count;
+  U32 material_id_count;
+  U32 material_count;
+  U32 source_count;
+  U32 _pad;
+};
+
+// changes whenever a field of Vertex is added, removed, resized or moved
+static U64
+mesh_cache_vertex_layout_hash(void)
+{
+  U64 layout[] = {
+      sizeof(Vertex),
+      offsetof(Vertex, position),
+      sizeof(((Vertex *)0)->position),
+      offsetof(Vertex, tex_coords),
+      sizeof(((Vertex *)0)->tex_coords),
+      offsetof(Vertex, normal),
+      sizeof(((Vertex *)0)->normal),
+      sizeof(Material),
+      sizeof(MeshMaterial),
+  };
+
+  return hash_fnv1a(layout, sizeof(layout));
+}
+
+static void
+mesh_cache_path(char *dst, U64 dst_size, const char *obj_path)
+{
+  snprintf(dst, dst_size, "%s.mesh", obj_path);
+}
+
+B32
+mesh_cache_load(MeshCache *cache, const char *obj_path)
+{
+  MemoryZero(cache, sizeof(MeshCache));
+
+  FileProperties source = os_file_properties(obj_path);
+  if (!source.exists) {
+    return 0;
+  }
+
+  char path[512];
+  mesh_cache_path(path, sizeof(path), obj_path);
+
+  if (!os_file_map(&cache->file, path)) {
+    return 0;
+  }
+
+  MeshCacheHeader *header = (MeshCacheHeader *)cache->file.data;
+
+  B32 valid = cache->file.size >= sizeof(MeshCacheHeader) && header->magic == MESH_CACHE_MAGIC && header->version == MESH_CACHE_VERSION &&
+              header->vertex_layout_hash == mesh_cache_vertex_layout_hash() &&
+              header->source_path_hash == hash_fnv1a(obj_path, strlen(obj_path)) && header->source_size == source.size &&
+              header->source_modified == source.modified;
+
+  if (valid) {
+    U64 expected_size = sizeof(MeshCacheHeader) + (U64)header->source_count * sizeof(MeshSource) +
+                        (U64)header->material_count * sizeof(MeshMaterial) + (U64)header->vertex_count * sizeof(Vertex) +
+                        (U64)header->index_count * sizeof(U32) + (U64)header->material_id_count * sizeof(S32);
+    valid = cache->file.size == expected_size;
+  }
+
+  MeshSource *sources = (MeshSource *)(header + 1);
+  for (U32 i = 0; valid && i < header->source_count; ++i) {
+    FileProperties props = os_file_properties(sources[i].path);
+    valid                = props.exists && props.size == sources[i].size && props.modified == sources[i].modified;
+  }
+
+  if (!valid) {
+    log_dev("Mesh cache is stale: %s", path);
+    os_file_unmap(&cache->file);
+    return 0;
+  }
+
+  U8 *data = (U8 *)(sources + header->source_count);
+
+  cache->materials = (MeshMaterial *)data;
+  data += header->material_count * sizeof(MeshMaterial);
+  cache->vertices = (Vertex *)data;
+  data += header->vertex_count * sizeof(Vertex);
+  cache->indices = (U32 *)data;
+  data += header->index_count * sizeof(U32);
+  cache->material_ids = (S32 *)data;
+
+  cache->vertex_count       = header->vertex_count;
+  cache->index_count        = header->index_count;
+  cache->material_id_count  = header->material_id_count;
+  cache->material_count     = header->material_count;
+
+  return 1;
+}
+
+void
+mesh_cache_write(const char *obj_path, Vertex *vertices, U32 vertex_count, U32 *indices, U32 index_count, S32 *material_ids,
+                 U32 material_id_count, MeshMaterial *materials, U32 material_count, const char **source_paths, U32 source_count)
+{
+  FileProperties source = os_file_properties(obj_path);
+  if (!source.exists) {
+    return;
+  }
+
+  Temp scratch = scratch_begin(0, 0);
+
+  MeshSource *sources = push_array(scratch.arena, MeshSource, source_count);
+  for (U32 i = 0; i < source_count; ++i) {
+    FileProperties props = os_file_properties(source_paths[i]);
+    U64            size  = strlen(source_paths[i]) + 1;
+
+    // without a complete path the cache could never be validated
+    if (size > MESH_PATH_MAX) {
+      log_dev("Not caching mesh, path too long: %s", source_paths[i]);
+      scratch_end(scratch);
+      return;
+    }
+
+    MemoryCopy(sources[i].path, source_paths[i], size);
+    sources[i].size     = props.size;
+    sources[i].modified = props.modified;
+  }
+
+  char path[512];
+  mesh_cache_path(path, sizeof(path), obj_path);
+
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    log_dev("Failed to write mesh cache: %s", path);
+    scratch_end(scratch);
+    return;
+  }
+
+  MeshCacheHeader header    = {0};
+  header.magic              = MESH_CACHE_MAGIC;
+  header.version            = MESH_CACHE_VERSION;
+  header.vertex_layout_hash = mesh_cache_vertex_layout_hash();
+  header.source_path_hash   = hash_fnv1a(obj_path, strlen(obj_path));
+  header.source_size        = source.size;
+  header.source_modified    = source.modified;
+  header.vertex_count       = vertex_count;
+  header.index_count        = index_count;
+  header.material_id_count  = material_id_count;
+  header.material_count     = material_count;
+  header.source_count       = source_count;
+
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(sources, sizeof(MeshSource), source_count, f);
+  fwrite(materials, sizeof(MeshMaterial), material_count, f);
+  fwrite(vertices, sizeof(Vertex), vertex_count, f);
+  fwrite(indices, sizeof(U32), index_count, f);
+  fwrite(material_ids, sizeof(S32), material_id_count, f);
+  fclose(f);
+
+  scratch_end(scratch);
+}
+
+void
+mesh_cache_free(MeshCache *cache)
+{
+  os_file_unmap(&cache->file);
+  MemoryZero(cache, sizeof(MeshCache));
+}
@@ -1,16 +1,151 @@
 #include "models.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 void
-models_write_descriptors(VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool, DescriptorSet *desc_set,
-                         ModelDescriptor *descriptors, U32 descriptor_count)
+models_init(Models *models)
+{
+  MemoryZero(models, sizeof(Models));
+}
+
+// doubles capacity until count fits, the array keeps its contents
+static void *
+models_grow(void *array, U32 *capacity, U64 count, U64 item_size)
+{
+  if (count <= *capacity) {
+    return array;
+  }
+
+  Assert(count <= max_U32);
+
+  U64 new_capacity = Max(*capacity, 64);
+  while (new_capacity < count) {
+    new_capacity *= 2;
+  }
+
+  *capacity = (U32)Min(new_capacity, max_U32);
+  return realloc(array, *capacity * item_size);
+}
+
+// Appends a model whose geometry the caller writes into the reserved ranges of the cpu arrays, nothing is on the gpu
+// until models_write_descriptors. The pointer is only valid until the next push.
+Model *
+models_push(Models *models, U32 vertex_count, U32 index_count, U32 material_index_count)
+{
+  models->models   = (Model *)models_grow(models->models, &models->capacity, (U64)models->count + 1, sizeof(Model));
+  models->vertices = (Vertex *)models_grow(models->vertices, &models->vertex_capacity, (U64)models->vertex_count + vertex_count,
+                                           sizeof(Vertex));
+  models->indices  = (U32 *)models_grow(models->indices, &models->index_capacity, (U64)models->index_count + index_count, sizeof(U32));
+  models->material_indices = (U32 *)models_grow(models->material_indices, &models->material_index_capacity,
+                                                (U64)models->material_index_count + material_index_count, sizeof(U32));
+
+  Model *m = &models->models[models->count];
+  MemoryZero(m, sizeof(Model));
+
+  m->index                = models->count++;
+  m->first_index          = models->index_count;
+  m->index_count          = index_count;
+  m->vertex_offset        = (S32)models->vertex_count;
+  m->first_material_index = models->material_index_count;
+
+  models->vertex_count += vertex_count;
+  models->index_count += index_count;
+  models->material_index_count += material_index_count;
+
+  return m;
+}
+
+static VkDeviceAddress
+models_buffer_address(Device *ldevice, Buffer *buffer)
 {
-  U32 size = descriptor_count * sizeof(ModelDescriptor);
+  VkBufferDeviceAddressInfo address_info = {VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR};
+  address_info.buffer                    = buffer->handle;
+
+  return vkGetBufferDeviceAddress(ldevice->handle, &address_info);
+}
+
+// Has to be called once after every model and its instances were added. The copies are only recorded,
+// they are submitted with the rest of the scene on uploader_flush.
+void
+models_write_descriptors(Models *models, VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader, DescriptorSet *desc_set)
+{
+  // empty buffers are not allowed, a scene without geometry still gets one element
+  VkDeviceSize vertices_size         = (VkDeviceSize)Max(models->vertex_count, 1) * sizeof(Vertex);
+  VkDeviceSize indices_size          = (VkDeviceSize)Max(models->index_count, 1) * sizeof(U32);
+  VkDeviceSize material_indices_size = (VkDeviceSize)Max(models->material_index_count, 1) * sizeof(U32);
+  VkDeviceSize descriptors_size      = (VkDeviceSize)Max(models->count, 1) * sizeof(ModelDescriptor);
+  VkDeviceSize draws_size            = (VkDeviceSize)Max(models->count, 1) * sizeof(VkDrawIndexedIndirectCommand);
+
+  models->vertex_buffer         = buffer_create_device(vertices_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, pdevice, ldevice);
+  models->index_buffer          = buffer_create_device(indices_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, pdevice, ldevice);
+  models->material_index_buffer = buffer_create_device(
+      material_indices_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, pdevice, ldevice);
+  models->descriptor_buffer = buffer_create_device(descriptors_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, pdevice, ldevice);
+
+  // storage as well, so a culling pass can rewrite the commands later on
+  models->draw_buffer =
+      buffer_create_device(draws_size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, pdevice, ldevice);
+
+  if (models->vertex_count) {
+    uploader_upload_buffer(uploader, &models->vertex_buffer, 0, models->vertices, models->vertex_count * sizeof(Vertex));
+  }
+  if (models->index_count) {
+    uploader_upload_buffer(uploader, &models->index_buffer, 0, models->indices, models->index_count * sizeof(U32));
+  }
+  if (models->material_index_count) {
+    uploader_upload_buffer(uploader, &models->material_index_buffer, 0, models->material_indices,
+                           models->material_index_count * sizeof(U32));
+  }
+
+  // the upload copied them into staging memory, the gpu buffers are the only copy from here on
+  free(models->vertices);
+  free(models->indices);
+  free(models->material_indices);
+  models->vertices                = 0;
+  models->indices                 = 0;
+  models->material_indices        = 0;
+  models->vertex_capacity         = 0;
+  models->index_capacity          = 0;
+  models->material_index_capacity = 0;
+
+  // Descriptors and draw commands are written straight into the staging memory. Staging can flush the batch when
+  // the ring is full, so each region is filled before the next one is staged.
+  VkDeviceAddress  material_indices_address = models_buffer_address(ldevice, &models->material_index_buffer);
+  ModelDescriptor *descriptors = (ModelDescriptor *)uploader_stage_buffer(uploader, &models->descriptor_buffer, 0, descriptors_size);
+
+  for (U32 i = 0; i < models->count; ++i) {
+    Model *m = &models->models[i];
+
+    descriptors[i].material_index_buffer_address = material_indices_address + (VkDeviceAddress)m->first_material_index * sizeof(U32);
+  }
+
+  VkDrawIndexedIndirectCommand *draws =
+      (VkDrawIndexedIndirectCommand *)uploader_stage_buffer(uploader, &models->draw_buffer, 0, draws_size);
+
+  models->draw_count     = 0;
+  models->instance_count = 0;
+  models->triangle_count = 0;
+
+  for (U32 i = 0; i < models->count; ++i) {
+    Model *m = &models->models[i];
+
+    if (!m->instance_count) {
+      continue;
+    }
 
-  // @Todo: this buffer is never destroyed - do when we have a model manager
-  Buffer buffer =
-      buffer_create(size, descriptors, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, pdevice, ldevice, cmd_pool);
+    VkDrawIndexedIndirectCommand *draw = &draws[models->draw_count++];
+    draw->indexCount                   = m->index_count;
+    draw->instanceCount                = m->instance_count;
+    draw->firstIndex                   = m->first_index;
+    draw->vertexOffset                 = m->vertex_offset;
+    draw->firstInstance                = m->first_instance;
 
-  VkDescriptorBufferInfo buffer_desc = {buffer.handle, 0, VK_WHOLE_SIZE};
+    models->instance_count += m->instance_count;
+    models->triangle_count += (U64)(m->index_count / 3) * m->instance_count;
+  }
+
+  VkDescriptorBufferInfo buffer_desc = {models->descriptor_buffer.handle, 0, VK_WHOLE_SIZE};
 
   VkWriteDescriptorSet desc_write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
   desc_write.dstSet               = desc_set->handle;
@@ -23,9 +158,86 @@ models_write_descriptors(VkPhysicalDevice pdevice, Device *ldevice, VkCommandPoo
 }
 
 void
-model_free(Model *m, Device *ldevice)
+models_free(Models *models, Device *ldevice)
+{
+  if (models->vertex_buffer.handle != VK_NULL_HANDLE) {
+    buffer_destroy(&models->vertex_buffer, ldevice);
+    buffer_destroy(&models->index_buffer, ldevice);
+    buffer_destroy(&models->material_index_buffer, ldevice);
+    buffer_destroy(&models->descriptor_buffer, ldevice);
+    buffer_destroy(&models->draw_buffer, ldevice);
+  }
+
+  free(models->models);
+  free(models->vertices);
+  free(models->indices);
+  free(models->material_indices);
+  MemoryZero(models, sizeof(Models));
+}
+
+void
+model_instances_init(ModelInstances *instances)
+{
+  *instances = (ModelInstances){.instances = 0, .count = 0, .capacity = 1, .buffer = {0}};
+}
+
+// a model's instances are added at once, so they end up as one contiguous range
+void
+model_instances_add(ModelInstances *instances, Model *m, Mat4 *transforms, U32 count)
+{
+  Assert(m->instance_count == 0);
+
+  while (instances->count + count > instances->capacity) {
+    Assert(instances->capacity < max_U32 / 2);
+    instances->capacity *= 2;
+  }
+  instances->instances = (ModelInstance *)realloc(instances->instances, instances->capacity * sizeof(ModelInstance));
+
+  m->first_instance = instances->count;
+  m->instance_count = count;
+
+  for (U32 i = 0; i < count; ++i) {
+    ModelInstance *instance = &instances->instances[instances->count++];
+    instance->model_matrix  = transforms[i];
+    instance->normal_matrix = mat4_transpose(mat4_inverse(transforms[i]));
+    instance->model_index   = m->index;
+  }
+}
+
+void
+model_instances_write_descriptors(ModelInstances *instances, VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader,
+                                  DescriptorSet *desc_set)
 {
-  buffer_destroy(&m->vertex_buffer, ldevice);
-  buffer_destroy(&m->index_buffer, ldevice);
-  buffer_destroy(&m->material_index_buffer, ldevice);
+  if (instances->buffer.handle != VK_NULL_HANDLE) {
+    buffer_destroy(&instances->buffer, ldevice);
+  }
+
+  U32 size = Max(instances->count, 1) * sizeof(ModelInstance);
+
+  instances->buffer = buffer_create_device(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, pdevice, ldevice);
+  if (instances->count) {
+    uploader_upload_buffer(uploader, &instances->buffer, 0, instances->instances, instances->count * sizeof(ModelInstance));
+  }
+
+  VkDescriptorBufferInfo buffer_desc = {instances->buffer.handle, 0, VK_WHOLE_SIZE};
+
+  VkWriteDescriptorSet desc_write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  desc_write.dstSet               = desc_set->handle;
+  desc_write.dstBinding           = 3;
+  desc_write.descriptorCount      = 1;
+  desc_write.descriptorType       = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  desc_write.pBufferInfo          = &buffer_desc;
+
+  vkUpdateDescriptorSets(ldevice->handle, 1, &desc_write, 0, 0);
+}
+
+void
+model_instances_free(ModelInstances *instances, Device *ldevice)
+{
+  if (instances->buffer.handle != VK_NULL_HANDLE) {
+    buffer_destroy(&instances->buffer, ldevice);
+  }
+
+  free(instances->instances);
+  MemoryZero(instances, sizeof(ModelInstances));
 }
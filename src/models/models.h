@@ -1,6 +1,7 @@
 #pragma once
 
 #include "base/base.h"
+#include "base/base_os.h"
 
 #include "nvulkan/nvulkan.h"
 
@@ -15,6 +16,13 @@ typedef struct Materials       Materials;
 typedef struct DiffuseTextures DiffuseTextures;
 typedef struct ModelDescriptor ModelDescriptor;
 typedef struct Model           Model;
+typedef struct Models          Models;
+typedef struct ModelInstance   ModelInstance;
+typedef struct ModelInstances  ModelInstances;
+typedef struct MeshMaterial    MeshMaterial;
+typedef struct MeshSource      MeshSource;
+typedef struct MeshCache       MeshCache;
+typedef struct TextureCache    TextureCache;
 // typedef struct SceneRenderer   SceneRenderer;
 typedef struct PBRRenderer PBRRenderer;
 
@@ -47,37 +55,168 @@ struct Material {
     s32  texture_offset;
 };*/
 
+// texture slots of a material, have to match the shader
+#define MATERIAL_TEXTURE_ALBEDO    0
+#define MATERIAL_TEXTURE_ROUGHNESS 1
+#define MATERIAL_TEXTURE_METALLIC  2
+#define MATERIAL_TEXTURE_NORMAL    3
+#define MATERIAL_TEXTURE_COUNT     4
+
 struct Material {
   Vec4 albedo;
   F32  metallic;
   F32  specular;
   F32  roughness;
   F32  _pad;
+  S32  textures[MATERIAL_TEXTURE_COUNT]; // index into the diffuse textures, -1 if unused
 };
 
+// Identical materials are only stored once, whatever their names. Both the material contents and the names are
+// indexed by open addressing tables with linear probing, kept at most half full. Names are interned into the arena,
+// so callers can pass temporary strings, and every name refers to the material it was added with.
 struct Materials {
   Material    *materials;
-  const char **names;
+  U64         *material_hashes; // of the material bytes
+  B8          *dirty;           // changed on the cpu since the last upload
+  U32          dirty_count;
   U32          count;
   U32          capacity;
+  U32         *material_slots; // index + 1 into materials, 0 is empty
+  U32          material_slot_count;
+  const char **names;
+  U64         *name_hashes;
+  U32         *name_materials; // index into materials of every name
+  U32          name_count;
+  U32          name_capacity;
+  U32         *name_slots; // index + 1 into names, 0 is empty
+  U32          name_slot_count;
+  Arena       *arena;
   Buffer       buffer;
 };
 
+// Textures loaded from a path are only loaded once, the path hashes are compared before the interned paths.
+// Not only diffuse maps, every material texture lives here.
 struct DiffuseTextures {
-  Texture *textures;
-  U32      count;
-  U32      capacity;
+  Texture     *textures;
+  const char **paths; // null for textures that were not loaded from a path
+  U64         *path_hashes;
+  U32          count;
+  U32          capacity;
+  Arena       *arena;
+};
+
+// How a texture is stored on the gpu. With BC support they are cooked into block compressed caches, otherwise
+// uploaded as rgba8. Normals only keep xy in the compressed format, the shader reconstructs z.
+#define TEXTURE_KIND_COLOR  0 // srgb, BC1
+#define TEXTURE_KIND_SCALAR 1 // linear, only red is used, BC4
+#define TEXTURE_KIND_NORMAL 2 // linear tangent space normal, BC5
+#define TEXTURE_KIND_COUNT  3
+
+#define TEXTURE_LEVEL_MAX 16
+
+// Mapped view of a cooked texture or a KTX2 file, data points into the file mapping unless the file was supercompressed
+struct TextureCache {
+  FileMap      file;
+  U8          *decoded; // inflated levels of a supercompressed file, owned
+  U8          *data;    // every mip level, uploaded with one copy
+  U64          size;
+  VkDeviceSize level_offsets[TEXTURE_LEVEL_MAX]; // where each level starts in data
+  VkFormat     format;
+  U32          width;
+  U32          height;
+  U32          mip_levels;
 };
 
 struct ModelDescriptor {
-  U64 material_index_buffer_address;
+  U64 material_index_buffer_address; // where the model's range of Models.material_index_buffer starts
 };
 
+// A range of the shared geometry buffers, indices are local to the model and offset by vertex_offset
 struct Model {
+  U32  index;       // in Models, instances refer to their model with it
+  U32  first_index; // range in Models.index_buffer
+  U32  index_count;
+  S32  vertex_offset;
+  U32  first_material_index; // range in Models.material_index_buffer, one per triangle
+  Vec3 bounds_min;           // object space
+  Vec3 bounds_max;
+  U32  first_instance; // range in ModelInstances, drawn with one instanced draw
+  U32  instance_count;
+};
+
+// Geometry of every model is appended to cpu arrays while loading, models_write_descriptors sub allocates it from
+// shared buffers and builds one indirect draw command per model, so the whole scene is drawn with one call.
+struct Models {
+  Model *models;
+  U32    count;
+  U32    capacity;
+
+  // released once they are uploaded
+  Vertex *vertices;
+  U32    *indices;
+  U32    *material_indices;
+  U32     vertex_count;
+  U32     vertex_capacity;
+  U32     index_count;
+  U32     index_capacity;
+  U32     material_index_count;
+  U32     material_index_capacity;
+
   Buffer vertex_buffer;
   Buffer index_buffer;
   Buffer material_index_buffer;
-  U32    index_count;
+  Buffer descriptor_buffer;
+  Buffer draw_buffer; // VkDrawIndexedIndirectCommand of every model with instances, can be filled on the gpu as well
+  U32    draw_count;
+  U32    instance_count;
+  U64    triangle_count;
+};
+
+// The normal matrix is computed on the cpu when the instance is added, so the shader never inverts per vertex.
+// Has to match the shader, mat4 columns keep the std430 layout the same as in C.
+struct ModelInstance {
+  Mat4 model_matrix;
+  Mat4 normal_matrix; // inverse transpose of model_matrix, only the upper 3x3 is used
+  U32  model_index;   // the fragment shader looks up the material indices with it
+  U32  _pad[3];
+};
+
+// Transforms of every model in one storage buffer, a model's instances are contiguous
+struct ModelInstances {
+  ModelInstance *instances;
+  U32            count;
+  U32            capacity;
+  Buffer         buffer;
+};
+
+#define MESH_NAME_MAX 64
+#define MESH_PATH_MAX 256
+
+// Material as read from the mtl, the textures are still paths and are resolved when the model is loaded
+struct MeshMaterial {
+  char     name[MESH_NAME_MAX];
+  Material material;
+  char     textures[MATERIAL_TEXTURE_COUNT][MESH_PATH_MAX]; // empty if unused
+};
+
+// a file besides the obj the cooked mesh was made from, i.e. its mtl libraries
+struct MeshSource {
+  char path[MESH_PATH_MAX];
+  U64  size;
+  U64  modified;
+};
+
+// Mapped view of a cooked mesh, the arrays point into the file mapping
+struct MeshCache {
+  FileMap       file;
+  Vertex       *vertices;
+  U32          *indices;
+  S32          *material_ids;
+  MeshMaterial *materials; // indexed by the local material ids
+  U32           vertex_count;
+  U32           index_count;
+  U32           material_id_count;
+  U32           material_count;
 };
 
 /*
@@ -93,14 +232,28 @@ struct SceneRenderer {
     Buffer        uniforms;
 };*/
 
+// upper bound of the bindless texture array, the set is allocated with the number of loaded textures
+#define PBR_TEXTURE_MAX 16384
+
 struct PBRRenderer {
   Texture       color_image;
   Texture       depth_image;
+  VkFormat      color_format;
+  VkFormat      depth_format;
+  U32           width;
+  U32           height;
   VkRenderPass  render_pass;
   VkFramebuffer framebuffer;
-  DescriptorSet desc_set;
+  DescriptorSet desc_set;    // uniforms, materials, model descriptions and instances
+  DescriptorSet texture_set; // every material texture, indexed by Material.textures
   Pipeline      pipeline;
-  Buffer        uniforms;
+  U32           uniform_offset;      // dynamic offset of the current frame's GlobalUniforms in Frames.uniforms
+  B32           multi_draw_indirect; // otherwise every model is drawn on its own
+
+  // what the last pbr_renderer_render recorded
+  U32 draw_count; // draw calls, not models
+  U32 instance_count;
+  U64 triangle_count;
 };
 
 void materials_init(Materials *materials);
@@ -108,29 +261,50 @@ U32  materials_add(Materials *materials, const char *name, Material mat);
 B8   materials_has(Materials *materials, const char *name);
 U32  materials_get_index(Materials *materials, const char *name);
 void materials_free(Materials *materials, Device *ldevice);
-void materials_write_descriptors(Materials *materials, VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool,
+void materials_write_descriptors(Materials *materials, VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader,
                                  DescriptorSet *desc_set);
-void materials_update_uniforms(Materials *materials, VkCommandBuffer cmd_buf);
+void materials_mark_dirty(Materials *materials, U32 index);
+void materials_update_uniforms(Materials *materials, Frame *frame);
 
 void diffuse_textures_init(DiffuseTextures *textures);
-void diffuse_textures_add(DiffuseTextures *textures, Texture texture);
-void diffuse_textures_add_from_path(DiffuseTextures *textures, const char *path, VkPhysicalDevice pdevice, Device *ldevice,
-                                    VkCommandPool cmd_pool);
+U32  diffuse_textures_add(DiffuseTextures *textures, Texture texture);
+U32  diffuse_textures_add_from_path(DiffuseTextures *textures, const char *path, U32 kind, VkPhysicalDevice pdevice, Device *ldevice,
+                                    Uploader *uploader);
+void diffuse_textures_add_from_paths(DiffuseTextures *textures, const char **paths, U32 *kinds, U32 count, U32 *indices,
+                                     VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader);
 void diffuse_textures_free(DiffuseTextures *textures, Device *ldevice);
+void diffuse_textures_write_descriptors(DiffuseTextures *textures, Device *ldevice, DescriptorSet *desc_set);
+
+U32 model_load(VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader, Models *models, Materials *materials,
+               DiffuseTextures *diffuse_textures, const char *path);
+
+B32  mesh_cache_load(MeshCache *cache, const char *obj_path);
+void mesh_cache_write(const char *obj_path, Vertex *vertices, U32 vertex_count, U32 *indices, U32 index_count, S32 *material_ids,
+                      U32 material_id_count, MeshMaterial *materials, U32 material_count, const char **source_paths, U32 source_count);
+void mesh_cache_free(MeshCache *cache);
+
+B32  texture_cache_load(TextureCache *cache, const char *image_path, U32 kind);
+B32  texture_cache_load_ktx2(TextureCache *cache, const char *path);
+void texture_cache_write(const char *image_path, U32 kind, U8 *pixels, U32 width, U32 height);
+void texture_cache_free(TextureCache *cache);
 
-ModelDescriptor model_load(VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool, Model *m, Materials *materials,
-                           DiffuseTextures *diffuse_textures, const char *path);
+void   models_init(Models *models);
+Model *models_push(Models *models, U32 vertex_count, U32 index_count, U32 material_index_count);
+void   models_write_descriptors(Models *models, VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader, DescriptorSet *desc_set);
+void   models_free(Models *models, Device *ldevice);
 
-void models_write_descriptors(VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool, DescriptorSet *desc_set,
-                              ModelDescriptor *descriptors, uint32_t descriptor_count);
-void model_free(Model *m, Device *ldevice);
+void model_instances_init(ModelInstances *instances);
+void model_instances_add(ModelInstances *instances, Model *m, Mat4 *transforms, U32 count);
+void model_instances_write_descriptors(ModelInstances *instances, VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader,
+                                       DescriptorSet *desc_set);
+void model_instances_free(ModelInstances *instances, Device *ldevice);
 
-PBRRenderer pbr_renderer_create(VkPhysicalDevice pdevice, Device *ldevice, Swapchain *sc, VkCommandPool cmd_pool, VkFormat depth_format,
-                                uint32_t diffuse_texture_count);
+PBRRenderer pbr_renderer_create(VkPhysicalDevice pdevice, Device *ldevice, Frames *frames, U32 width, U32 height, VkCommandPool cmd_pool,
+                                VkFormat depth_format, uint32_t diffuse_texture_count);
+void        pbr_renderer_resize(PBRRenderer *r, VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool, U32 width, U32 height);
 void        pbr_renderer_destroy(PBRRenderer *r, Device *ldevice);
-void        pbr_renderer_render(PBRRenderer *r, Swapchain *sc, VkCommandBuffer cmd_buf, Model *models, U32 model_count,
-                                VkClearValue *clear_colors);
-void        pbr_renderer_update_uniforms(PBRRenderer *r, VkCommandBuffer cmd_buf, GlobalUniforms *uniforms);
+void        pbr_renderer_render(PBRRenderer *r, VkCommandBuffer cmd_buf, Models *models, VkClearValue *clear_colors);
+void        pbr_renderer_update_uniforms(PBRRenderer *r, Frame *frame, GlobalUniforms *uniforms);
 
 /*
 SceneRenderer scene_renderer_create(VkPhysicalDevice pdevice, Device *ldevice, Swapchain *sc, VkCommandPool cmd_pool, VkFormat depth_format,
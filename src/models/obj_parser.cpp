@@ -0,0 +1,457 @@
+#include "obj_parser.h"
+
+#include "base/base_os.h"
+#include "base/base_profile.h"
+
+#include <string.h>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+// Parses an obj the same way tinyobj::LoadObj does, but split into chunks on line boundaries:
+//   1. every chunk parses its v/vt/vn/f lines on a worker thread and records usemtl/mtllib in order
+//   2. mtl libraries and usemtl names are resolved in file order, counts are prefix summed
+//   3. every chunk fixes its relative indices and triangulates its faces on a worker thread
+// Triangulation goes through tinyobj's exportGroupsToShape so the output matches the single threaded loader.
+
+#define OBJ_MIN_CHUNK_SIZE   MB(8)
+#define OBJ_MAX_CHUNK_COUNT  64
+#define OBJ_FACES_PER_EXPORT 4096
+
+enum ObjEventKind {
+  ObjEventKind_UseMtl,
+  ObjEventKind_MtlLib,
+};
+
+struct ObjEvent {
+  ObjEventKind kind;
+  U64          face_index; // faces of the chunk that come before the event
+  std::string  name;
+};
+
+struct ObjMaterialRun {
+  U64 face_index;
+  S32 material_id;
+};
+
+struct ObjChunk {
+  const char *begin;
+  const char *end;
+
+  // phase 1
+  std::vector<F32>                     positions;
+  std::vector<F32>                     normals;
+  std::vector<F32>                     texcoords;
+  std::vector<tinyobj::vertex_index_t> face_vertices;
+  std::vector<U32>                     face_vertex_counts;
+  std::vector<U64>                     relative_slots; // face_vertices * 3 + component of indices relative to this chunk
+  std::vector<ObjEvent>                events;
+  B32                                  failed;
+
+  // phase 2
+  S32                         position_base;
+  S32                         texcoord_base;
+  S32                         normal_base;
+  std::vector<ObjMaterialRun> runs;
+  const std::vector<F32>     *all_positions;
+
+  // phase 3
+  std::vector<tinyobj::index_t> indices;
+  std::vector<S32>              material_ids;
+};
+
+// same as tinyobj's fixIndex, but relative indices can point into previous chunks so they are fixed up in phase 3
+static B32
+obj_chunk_fix_index(ObjChunk *chunk, int idx, int chunk_count, int *ret, B32 allow_zero, U64 slot)
+{
+  if (idx > 0) {
+    *ret = idx - 1;
+    return 1;
+  }
+
+  if (idx == 0) {
+    *ret = -1;
+    return allow_zero;
+  }
+
+  *ret = chunk_count + idx;
+  chunk->relative_slots.push_back(slot);
+  return 1;
+}
+
+static void
+obj_chunk_parse(void *param)
+{
+  ProfileScoped("obj_chunk_parse");
+
+  ObjChunk *chunk = (ObjChunk *)param;
+
+  std::string line;
+  for (const char *at = chunk->begin; at < chunk->end;) {
+    const char *line_end = (const char *)memchr(at, '\n', chunk->end - at);
+    if (!line_end) {
+      line_end = chunk->end;
+    }
+
+    // the parse functions of tinyobj expect a null terminated line
+    line.assign(at, line_end - at);
+    at = line_end + 1;
+
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+
+    const char *token = line.c_str();
+    token += strspn(token, " \t");
+
+    if (token[0] == '\0' || token[0] == '#') {
+      continue;
+    }
+
+    if (token[0] == 'v' && IS_SPACE(token[1])) {
+      token += 2;
+
+      tinyobj::real_t x, y, z, r, g, b;
+      tinyobj::parseVertexWithColor(&x, &y, &z, &r, &g, &b, &token);
+
+      chunk->positions.push_back(x);
+      chunk->positions.push_back(y);
+      chunk->positions.push_back(z);
+      continue;
+    }
+
+    if (token[0] == 'v' && token[1] == 'n' && IS_SPACE(token[2])) {
+      token += 3;
+
+      tinyobj::real_t x, y, z;
+      tinyobj::parseReal3(&x, &y, &z, &token);
+
+      chunk->normals.push_back(x);
+      chunk->normals.push_back(y);
+      chunk->normals.push_back(z);
+      continue;
+    }
+
+    if (token[0] == 'v' && token[1] == 't' && IS_SPACE(token[2])) {
+      token += 3;
+
+      tinyobj::real_t x, y;
+      tinyobj::parseReal2(&x, &y, &token);
+
+      chunk->texcoords.push_back(x);
+      chunk->texcoords.push_back(y);
+      continue;
+    }
+
+    if (token[0] == 'f' && IS_SPACE(token[1])) {
+      token += 2;
+      token += strspn(token, " \t");
+
+      int position_count = chunk->positions.size() / 3;
+      int texcoord_count = chunk->texcoords.size() / 2;
+      int normal_count   = chunk->normals.size() / 3;
+
+      U32 vertex_count = 0;
+      while (!IS_NEW_LINE(token[0])) {
+        tinyobj::vertex_index_t raw = tinyobj::parseRawTriple(&token);
+        tinyobj::vertex_index_t vi;
+
+        U64 slot = chunk->face_vertices.size() * 3;
+        if (!obj_chunk_fix_index(chunk, raw.v_idx, position_count, &vi.v_idx, 0, slot + 0) ||
+            !obj_chunk_fix_index(chunk, raw.vt_idx, texcoord_count, &vi.vt_idx, 1, slot + 1) ||
+            !obj_chunk_fix_index(chunk, raw.vn_idx, normal_count, &vi.vn_idx, 1, slot + 2)) {
+          chunk->failed = 1;
+          return;
+        }
+
+        chunk->face_vertices.push_back(vi);
+        vertex_count++;
+
+        token += strspn(token, " \t\r");
+      }
+
+      chunk->face_vertex_counts.push_back(vertex_count);
+      continue;
+    }
+
+    if (strncmp(token, "usemtl", 6) == 0) {
+      token += 6;
+
+      ObjEvent event   = {};
+      event.kind       = ObjEventKind_UseMtl;
+      event.face_index = chunk->face_vertex_counts.size();
+      event.name       = tinyobj::parseString(&token);
+      chunk->events.push_back(event);
+      continue;
+    }
+
+    if (strncmp(token, "mtllib", 6) == 0 && IS_SPACE(token[6])) {
+      token += 7;
+
+      ObjEvent event   = {};
+      event.kind       = ObjEventKind_MtlLib;
+      event.face_index = chunk->face_vertex_counts.size();
+      event.name       = token;
+      chunk->events.push_back(event);
+      continue;
+    }
+
+    // groups, objects, smoothing groups, lines, points and tags don't change the triangles we upload
+  }
+}
+
+static S32
+obj_chunk_fix_slot(ObjChunk *chunk, U64 slot)
+{
+  tinyobj::vertex_index_t *vi = &chunk->face_vertices[slot / 3];
+  switch (slot % 3) {
+  case 0:
+    return vi->v_idx += chunk->position_base;
+  case 1:
+    return vi->vt_idx += chunk->texcoord_base;
+  default:
+    return vi->vn_idx += chunk->normal_base;
+  }
+}
+
+static void
+obj_chunk_triangulate(void *param)
+{
+  ProfileScoped("obj_chunk_triangulate");
+
+  ObjChunk *chunk = (ObjChunk *)param;
+
+  for (U64 slot : chunk->relative_slots) {
+    if (obj_chunk_fix_slot(chunk, slot) < 0) {
+      chunk->failed = 1;
+      return;
+    }
+  }
+
+  std::vector<tinyobj::tag_t> tags;
+  std::string                 name;
+  std::string                 warn;
+
+  U64 face_count   = chunk->face_vertex_counts.size();
+  U64 vertex_index = 0;
+
+  tinyobj::PrimGroup group;
+  tinyobj::shape_t   shape;
+
+  for (U64 run_index = 0; run_index < chunk->runs.size(); run_index++) {
+    U64 run_begin = chunk->runs[run_index].face_index;
+    U64 run_end   = run_index + 1 < chunk->runs.size() ? chunk->runs[run_index + 1].face_index : face_count;
+
+    for (U64 face_begin = run_begin; face_begin < run_end; face_begin += OBJ_FACES_PER_EXPORT) {
+      U64 face_end = Min(face_begin + OBJ_FACES_PER_EXPORT, run_end);
+
+      group.clear();
+      for (U64 face_index = face_begin; face_index < face_end; face_index++) {
+        U32 vertex_count = chunk->face_vertex_counts[face_index];
+
+        tinyobj::face_t face;
+        face.vertex_indices.assign(chunk->face_vertices.begin() + vertex_index,
+                                   chunk->face_vertices.begin() + vertex_index + vertex_count);
+        group.faceGroup.push_back(face);
+
+        vertex_index += vertex_count;
+      }
+
+      shape = tinyobj::shape_t();
+      tinyobj::exportGroupsToShape(&shape, group, tags, chunk->runs[run_index].material_id, name, true, *chunk->all_positions, &warn);
+
+      chunk->indices.insert(chunk->indices.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+      chunk->material_ids.insert(chunk->material_ids.end(), shape.mesh.material_ids.begin(), shape.mesh.material_ids.end());
+    }
+  }
+}
+
+static void
+obj_chunks_run(ThreadFunction *func, std::vector<ObjChunk> &chunks)
+{
+  std::vector<Thread> threads(chunks.size() - 1);
+  for (U32 i = 1; i < chunks.size(); i++) {
+    threads[i - 1] = os_thread_launch(func, &chunks[i]);
+  }
+
+  // the calling thread takes the first chunk
+  func(&chunks[0]);
+
+  for (Thread thread : threads) {
+    os_thread_join(thread);
+  }
+}
+
+// mtl files write texture paths like "/Maps/a.jpg" even though they mean relative to the mtl
+std::string
+obj_join_path(const std::string &directory, const std::string &file)
+{
+  size_t begin = file.find_first_not_of("/\\");
+  if (begin == std::string::npos) {
+    return directory;
+  }
+
+  if (directory.empty()) {
+    return file.substr(begin);
+  }
+
+  return directory + "/" + file.substr(begin);
+}
+
+// same as the mtllib handling in tinyobj::LoadObj
+static void
+obj_load_mtl(ObjFile *obj, tinyobj::MaterialReader &mtl_reader, const std::string &line, std::set<std::string> &material_filenames,
+             std::map<std::string, int> &material_map)
+{
+  std::vector<std::string> filenames;
+  tinyobj::SplitString(line, ' ', '\\', filenames);
+
+  B32 found = 0;
+  for (const std::string &filename : filenames) {
+    if (material_filenames.count(filename) > 0) {
+      found = 1;
+      continue;
+    }
+
+    std::string warn;
+    std::string err;
+    if (mtl_reader(filename, &obj->materials, &material_map, &warn, &err)) {
+      found = 1;
+      material_filenames.insert(filename);
+      obj->mtl_paths.push_back(obj_join_path(obj->directory, filename));
+      break;
+    }
+  }
+
+  if (found) {
+    return;
+  }
+
+  log_dev("Failed to load material file(s) %s, using default material", line.c_str());
+}
+
+B32
+obj_file_parse(ObjFile *obj, const char *path)
+{
+  FileMap file = {};
+  if (!os_file_map(&file, path)) {
+    log_dev("Failed to open obj: %s", path);
+    return 0;
+  }
+
+  const char *data = (const char *)file.data;
+
+  U64 chunk_count = Clamp(1, file.size / OBJ_MIN_CHUNK_SIZE, Min(os_processor_count(), OBJ_MAX_CHUNK_COUNT));
+
+  // split on line boundaries, a chunk might end up empty if a line is longer than a chunk
+  std::vector<ObjChunk> chunks(chunk_count);
+  const char           *chunk_begin = data;
+  for (U64 i = 0; i < chunk_count; i++) {
+    const char *chunk_end = data + file.size;
+    if (i + 1 < chunk_count) {
+      chunk_end = Max(chunk_begin, data + file.size * (i + 1) / chunk_count);
+
+      const char *newline = (const char *)memchr(chunk_end, '\n', data + file.size - chunk_end);
+      chunk_end           = newline ? newline + 1 : data + file.size;
+    }
+
+    chunks[i].begin = chunk_begin;
+    chunks[i].end   = chunk_end;
+    chunk_begin     = chunk_end;
+  }
+
+  obj_chunks_run(obj_chunk_parse, chunks);
+
+  // mtl files are searched next to the obj like tinyobj::ObjReader does
+  std::string path_string = path;
+  size_t      separator   = path_string.find_last_of("/\\");
+  if (separator != std::string::npos) {
+    obj->directory = path_string.substr(0, separator);
+  }
+
+  tinyobj::MaterialFileReader mtl_reader(obj->directory);
+  std::set<std::string>       material_filenames;
+  std::map<std::string, int>  material_map;
+  S32                         material = -1;
+
+  U64 position_count = 0;
+  U64 texcoord_count = 0;
+  U64 normal_count   = 0;
+  B32 failed         = 0;
+
+  for (ObjChunk &chunk : chunks) {
+    failed |= chunk.failed;
+
+    chunk.position_base = position_count;
+    chunk.texcoord_base = texcoord_count;
+    chunk.normal_base   = normal_count;
+    position_count += chunk.positions.size() / 3;
+    texcoord_count += chunk.texcoords.size() / 2;
+    normal_count += chunk.normals.size() / 3;
+
+    chunk.runs.push_back({0, material});
+    for (const ObjEvent &event : chunk.events) {
+      if (event.kind == ObjEventKind_MtlLib) {
+        obj_load_mtl(obj, mtl_reader, event.name, material_filenames, material_map);
+        continue;
+      }
+
+      auto it              = material_map.find(event.name);
+      S32  new_material_id = it != material_map.end() ? it->second : -1;
+      if (new_material_id != material) {
+        material = new_material_id;
+        chunk.runs.push_back({event.face_index, material});
+      }
+    }
+  }
+
+  if (failed) {
+    log_dev("Failed to parse obj faces: %s", path);
+    os_file_unmap(&file);
+    return 0;
+  }
+
+  obj->attrib.vertices.reserve(position_count * 3);
+  obj->attrib.texcoords.reserve(texcoord_count * 2);
+  obj->attrib.normals.reserve(normal_count * 3);
+  for (ObjChunk &chunk : chunks) {
+    obj->attrib.vertices.insert(obj->attrib.vertices.end(), chunk.positions.begin(), chunk.positions.end());
+    obj->attrib.texcoords.insert(obj->attrib.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+    obj->attrib.normals.insert(obj->attrib.normals.end(), chunk.normals.begin(), chunk.normals.end());
+
+    std::vector<F32>().swap(chunk.positions);
+    std::vector<F32>().swap(chunk.texcoords);
+    std::vector<F32>().swap(chunk.normals);
+
+    chunk.all_positions = &obj->attrib.vertices;
+  }
+
+  obj_chunks_run(obj_chunk_triangulate, chunks);
+
+  U64 index_count    = 0;
+  U64 triangle_count = 0;
+  for (ObjChunk &chunk : chunks) {
+    failed |= chunk.failed;
+    index_count += chunk.indices.size();
+    triangle_count += chunk.material_ids.size();
+  }
+
+  if (failed) {
+    log_dev("Invalid relative index in obj: %s", path);
+    os_file_unmap(&file);
+    return 0;
+  }
+
+  obj->indices.reserve(index_count);
+  obj->material_ids.reserve(triangle_count);
+  for (ObjChunk &chunk : chunks) {
+    obj->indices.insert(obj->indices.end(), chunk.indices.begin(), chunk.indices.end());
+    obj->material_ids.insert(obj->material_ids.end(), chunk.material_ids.begin(), chunk.material_ids.end());
+  }
+
+  os_file_unmap(&file);
+
+  log_dev("Parsed obj %s in %llu chunks", path, (unsigned long long)chunk_count);
+
+  return 1;
+}
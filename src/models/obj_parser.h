@@ -0,0 +1,19 @@
+#pragma once
+
+#include "base/base.h"
+
+#include <tiny_obj_loader.h>
+
+// Result of parsing an obj, the same data tinyobj::ObjReader gives us but with the faces of all shapes flattened
+struct ObjFile {
+  tinyobj::attrib_t                attrib;
+  std::vector<tinyobj::index_t>    indices;      // triangulated, three per triangle
+  std::vector<S32>                 material_ids; // one per triangle
+  std::vector<tinyobj::material_t> materials;
+  std::string                      directory; // of the obj, mtl and texture paths are relative to it
+  std::vector<std::string>         mtl_paths; // every mtl library that was loaded
+};
+
+std::string obj_join_path(const std::string &directory, const std::string &file);
+
+B32 obj_file_parse(ObjFile *obj, const char *path);
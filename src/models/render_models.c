@@ -1,52 +1,96 @@
 #include "models.h"
 
-PBRRenderer
-pbr_renderer_create(VkPhysicalDevice pdevice, Device *ldevice, Swapchain *sc, VkCommandPool cmd_pool, VkFormat depth_format,
-                    uint32_t diffuse_texture_count)
-{
-  PBRRenderer r = {0};
+#include <string.h>
 
-  VkFormat color_format = VK_FORMAT_R32G32B32A32_SFLOAT;
-  U32      width        = sc->width;
-  U32      height       = sc->height;
+// color and depth targets are the only size dependent parts, everything else survives a resize
+static void
+pbr_renderer_create_targets(PBRRenderer *r, VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool, U32 width, U32 height)
+{
+  r->width  = width;
+  r->height = height;
 
-  // Create color and depth images
-  r.color_image =
-      texture_create(width, height, color_format, VK_IMAGE_ASPECT_COLOR_BIT,
-                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, pdevice, ldevice);
-  r.color_image.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  // transfer src so headless runs can read the result back
+  r->color_image = texture_create(width, height, r->color_format, VK_IMAGE_ASPECT_COLOR_BIT,
+                                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+                                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                  pdevice, ldevice);
+  r->color_image.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-  r.depth_image =
-      texture_create(width, height, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, pdevice, ldevice);
+  r->depth_image = texture_create(width, height, r->depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                                  pdevice, ldevice);
 
   // Transition image layouts
   VkCommandBuffer cmd_buf = command_buffer_allocate(ldevice, cmd_pool);
   command_buffer_begin(cmd_buf);
 
-  image_transition_layout(&r.color_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT, cmd_buf);
-  image_transition_layout(&r.depth_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+  image_transition_layout(&r->color_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT, cmd_buf);
+  image_transition_layout(&r->depth_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
                           VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, cmd_buf);
 
   command_buffer_submit(cmd_buf, ldevice);
   command_buffer_free(cmd_buf, ldevice, cmd_pool);
 
+  r->framebuffer = frame_buffer_create(ldevice, r->render_pass, r->color_image.image.view, r->depth_image.image.view, width, height);
+}
+
+static void
+pbr_renderer_destroy_targets(PBRRenderer *r, Device *ldevice)
+{
+  frame_buffer_destroy(r->framebuffer, ldevice);
+  texture_destroy(&r->color_image, ldevice);
+  texture_destroy(&r->depth_image, ldevice);
+}
+
+PBRRenderer
+pbr_renderer_create(VkPhysicalDevice pdevice, Device *ldevice, Frames *frames, U32 width, U32 height, VkCommandPool cmd_pool,
+                    VkFormat depth_format, uint32_t diffuse_texture_count)
+{
+  PBRRenderer r  = {0};
+  r.color_format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  r.depth_format = depth_format;
+
+  r.multi_draw_indirect = ldevice->multi_draw_indirect;
+
   // Create render pass for offscreen rendering
-  r.render_pass = render_pass_create_offscreen(color_format, r.depth_image.image.format, ldevice);
+  r.render_pass = render_pass_create_offscreen(r.color_format, r.depth_format, ldevice);
 
-  // Create framebuffer
-  r.framebuffer = frame_buffer_create(sc, r.render_pass, r.color_image.image.view, r.depth_image.image.view);
+  // Create color and depth images and the framebuffer
+  pbr_renderer_create_targets(&r, pdevice, ldevice, cmd_pool, width, height);
 
   // Create descriptor set
   VkDescriptorSetLayoutBinding bindings[] = {
-      {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, 0},
+      {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, 0},
       {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
       {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
-      {3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, diffuse_texture_count,
-       VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0},
+      {3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, 0},
   };
 
   r.desc_set = descriptor_set_create(bindings, ArrayCount(bindings), ldevice);
 
+  // The texture array is bounded by the device as well. Materials index every loaded texture, so a scene with more
+  // textures than the array can hold would sample past the set.
+  VkPhysicalDeviceVulkan12Properties properties_vulkan12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES};
+  VkPhysicalDeviceProperties2        properties          = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties.pNext                                       = &properties_vulkan12;
+  vkGetPhysicalDeviceProperties2(pdevice, &properties);
+
+  U32 texture_max = Min(PBR_TEXTURE_MAX, properties_vulkan12.maxDescriptorSetUpdateAfterBindSampledImages);
+  texture_max     = Min(texture_max, properties_vulkan12.maxPerStageDescriptorUpdateAfterBindSampledImages);
+
+  if (diffuse_texture_count > texture_max) {
+    log_fatal("The scene uses %u textures, but at most %u can be bound!", diffuse_texture_count, texture_max);
+  }
+
+  // Textures get their own set, update after bind doesn't allow the dynamic uniform buffer of set 0.
+  // Slots nobody writes stay unbound, materials only index the textures that exist.
+  VkDescriptorSetLayoutBinding texture_binding = {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture_max,
+                                                  VK_SHADER_STAGE_FRAGMENT_BIT, 0};
+
+  VkDescriptorBindingFlags texture_flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+  texture_flags |= VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+
+  r.texture_set = descriptor_set_create_indexed(&texture_binding, &texture_flags, 1, diffuse_texture_count, ldevice);
+
   // Setup graphics pipeline
   Shader shaders[] = {
       {"assets/shaders/vert.spv", VK_SHADER_STAGE_VERTEX_BIT},
@@ -61,21 +105,20 @@ pbr_renderer_create(VkPhysicalDevice pdevice, Device *ldevice, Swapchain *sc, Vk
       {2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)},
   };
 
-  r.pipeline = pipeline_create(ldevice, &r.desc_set, r.render_pass, shaders, ArrayCount(shaders), vertex_bindings,
-                               ArrayCount(vertex_bindings), vertex_attributes, ArrayCount(vertex_attributes), VK_CULL_MODE_FRONT_BIT);
+  DescriptorSet desc_sets[] = {r.desc_set, r.texture_set};
 
-  float null_uniforms[sizeof(GlobalUniforms)] = {0};
-  r.uniforms = buffer_create(sizeof(GlobalUniforms), null_uniforms, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                             pdevice, ldevice, cmd_pool);
+  r.pipeline = pipeline_create(ldevice, desc_sets, ArrayCount(desc_sets), r.render_pass, shaders, ArrayCount(shaders), vertex_bindings,
+                               ArrayCount(vertex_bindings), vertex_attributes, ArrayCount(vertex_attributes), VK_CULL_MODE_FRONT_BIT);
 
-  VkDescriptorBufferInfo buffer_desc = {r.uniforms.handle, 0, VK_WHOLE_SIZE};
+  // GlobalUniforms live in the frames' uniform ring, the frame's offset is given when binding
+  VkDescriptorBufferInfo buffer_desc = {frames->uniforms.handle, 0, sizeof(GlobalUniforms)};
 
   // Write uniform buffer descriptor GlobalUniforms
   VkWriteDescriptorSet desc_write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
   desc_write.dstSet               = r.desc_set.handle;
   desc_write.dstBinding           = 0;
   desc_write.descriptorCount      = 1;
-  desc_write.descriptorType       = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  desc_write.descriptorType       = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
   desc_write.pBufferInfo          = &buffer_desc;
 
   vkUpdateDescriptorSets(ldevice->handle, 1, &desc_write, 0, 0);
@@ -83,75 +126,84 @@ pbr_renderer_create(VkPhysicalDevice pdevice, Device *ldevice, Swapchain *sc, Vk
   return r;
 }
 
+void
+pbr_renderer_resize(PBRRenderer *r, VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool, U32 width, U32 height)
+{
+  pbr_renderer_destroy_targets(r, ldevice);
+  pbr_renderer_create_targets(r, pdevice, ldevice, cmd_pool, width, height);
+}
+
 void
 pbr_renderer_destroy(PBRRenderer *r, Device *ldevice)
 {
-  buffer_destroy(&r->uniforms, ldevice);
   pipeline_destroy(&r->pipeline, ldevice);
+  descriptor_set_destroy(&r->texture_set, ldevice);
   descriptor_set_destroy(&r->desc_set, ldevice);
-  frame_buffer_destroy(r->framebuffer, ldevice);
   render_pass_destroy(r->render_pass, ldevice);
-  texture_destroy(&r->color_image, ldevice);
-  texture_destroy(&r->depth_image, ldevice);
+  pbr_renderer_destroy_targets(r, ldevice);
 }
 
 void
-pbr_renderer_render(PBRRenderer *r, Swapchain *sc, VkCommandBuffer cmd_buf, Model *models, U32 model_count, VkClearValue *clear_colors)
+pbr_renderer_render(PBRRenderer *r, VkCommandBuffer cmd_buf, Models *models, VkClearValue *clear_colors)
 {
   VkRenderPassBeginInfo begin_info = {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
   begin_info.clearValueCount       = 2;
   begin_info.pClearValues          = clear_colors;
   begin_info.renderPass            = r->render_pass;
   begin_info.framebuffer           = r->framebuffer;
-  begin_info.renderArea            = (VkRect2D){{0, 0}, {sc->width, sc->height}};
+  begin_info.renderArea            = (VkRect2D){{0, 0}, {r->width, r->height}};
 
   // Rendering Scene
   vkCmdBeginRenderPass(cmd_buf, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
-  VkViewport viewport = {0.0f, 0.0f, sc->width, sc->height, 0.0f, 1.0f};
+  VkViewport viewport = {0.0f, 0.0f, r->width, r->height, 0.0f, 1.0f};
   vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
 
-  VkRect2D scissor = {{0, 0}, {sc->width, sc->height}};
+  VkRect2D scissor = {{0, 0}, {r->width, r->height}};
   vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
 
   vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipeline.handle);
-  vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipeline.layout, 0, 1, &r->desc_set.handle, 0, 0);
+  VkDescriptorSet desc_sets[] = {r->desc_set.handle, r->texture_set.handle};
+  vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipeline.layout, 0, ArrayCount(desc_sets), desc_sets, 1,
+                          &r->uniform_offset);
 
-  for (uint32_t i = 0; i < model_count; ++i) {
-    Model *model = &models[i];
+  r->draw_count     = 0;
+  r->instance_count = models->instance_count;
+  r->triangle_count = models->triangle_count;
 
+  // every model lives in the same buffers, they are bound once for the whole scene
+  if (models->draw_count) {
     VkDeviceSize offset = 0;
-    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &model->vertex_buffer.handle, &offset);
-    vkCmdBindIndexBuffer(cmd_buf, model->index_buffer.handle, offset, VK_INDEX_TYPE_UINT32);
-    vkCmdDrawIndexed(cmd_buf, model->index_count, 1, 0, 0, 0);
+    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &models->vertex_buffer.handle, &offset);
+    vkCmdBindIndexBuffer(cmd_buf, models->index_buffer.handle, 0, VK_INDEX_TYPE_UINT32);
+
+    // gl_InstanceIndex starts at first_instance, the shader indexes the instance buffer with it directly
+    if (r->multi_draw_indirect) {
+      vkCmdDrawIndexedIndirect(cmd_buf, models->draw_buffer.handle, 0, models->draw_count, sizeof(VkDrawIndexedIndirectCommand));
+      r->draw_count++;
+    } else {
+      for (U32 i = 0; i < models->count; ++i) {
+        Model *model = &models->models[i];
+        if (!model->instance_count) {
+          continue;
+        }
+
+        vkCmdDrawIndexed(cmd_buf, model->index_count, model->instance_count, model->first_index, model->vertex_offset,
+                         model->first_instance);
+        r->draw_count++;
+      }
+    }
   }
 
   vkCmdEndRenderPass(cmd_buf);
 }
 
+// has to be called every frame before pbr_renderer_render, the data only lives as long as the frame
 void
-pbr_renderer_update_uniforms(PBRRenderer *r, VkCommandBuffer cmd_buf, GlobalUniforms *uniforms)
+pbr_renderer_update_uniforms(PBRRenderer *r, Frame *frame, GlobalUniforms *uniforms)
 {
-  VkBufferMemoryBarrier beforeBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
-  beforeBarrier.srcAccessMask         = VK_ACCESS_SHADER_READ_BIT;
-  beforeBarrier.dstAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
-  beforeBarrier.buffer                = r->uniforms.handle;
-  beforeBarrier.offset                = 0;
-  beforeBarrier.size                  = sizeof(GlobalUniforms);
-  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_DEPENDENCY_DEVICE_GROUP_BIT, 0, 0,
-                       1, &beforeBarrier, 0, 0);
-
-  vkCmdUpdateBuffer(cmd_buf, r->uniforms.handle, 0, sizeof(GlobalUniforms), uniforms);
-
-  VkBufferMemoryBarrier afterBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
-  afterBarrier.srcAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
-  afterBarrier.dstAccessMask         = VK_ACCESS_SHADER_READ_BIT;
-  afterBarrier.buffer                = r->uniforms.handle;
-  afterBarrier.offset                = 0;
-  afterBarrier.size                  = sizeof(GlobalUniforms);
-  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_DEPENDENCY_DEVICE_GROUP_BIT, 0, 0,
-                       1, &afterBarrier, 0, 0);
-};
+  r->uniform_offset = frame_push_uniforms(frame, uniforms, sizeof(GlobalUniforms));
+}
 
 /*
 SceneRenderer
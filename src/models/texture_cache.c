@@ -0,0 +1,623 @@
+#include "models.h"
+
+#include "base/base_profile.h"
+
+#include "stb_image.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Cooked textures are stored next to the image as "<path>.bc1", ".bc4" or ".bc5" depending on the kind:
+//   TextureCacheHeader | blocks of every mip level, tightly packed starting with level 0
+// The mips are box filtered on the cpu (colors in linear space) and every level is encoded separately, so
+// loading is one mapping and one copy into the staging ring.
+
+#define TEXTURE_CACHE_MAGIC   0x58544342u // "BCTX"
+#define TEXTURE_CACHE_VERSION 1
+
+typedef struct TextureCacheHeader TextureCacheHeader;
+
+struct TextureCacheHeader {
+  U32 magic;
+  U32 version;
+  U64 source_path_hash;
+  U64 source_size;
+  U64 source_modified;
+  U32 kind;
+  U32 width;
+  U32 height;
+  U32 mip_levels;
+  U64 data_size;
+};
+
+static const char *g_texture_cache_extensions[TEXTURE_KIND_COUNT] = {"bc1", "bc4", "bc5"};
+static VkFormat    g_texture_cache_formats[TEXTURE_KIND_COUNT]    = {VK_FORMAT_BC1_RGB_SRGB_BLOCK, VK_FORMAT_BC4_UNORM_BLOCK,
+                                                                     VK_FORMAT_BC5_UNORM_BLOCK};
+
+static void
+texture_cache_path(char *dst, U64 dst_size, const char *image_path, U32 kind)
+{
+  snprintf(dst, dst_size, "%s.%s", image_path, g_texture_cache_extensions[kind]);
+}
+
+static U32
+texture_kind_block_size(U32 kind)
+{
+  return kind == TEXTURE_KIND_NORMAL ? 16 : 8;
+}
+
+static U32
+texture_mip_levels(U32 width, U32 height)
+{
+  U32 levels = 1;
+  while (width > 1 || height > 1) {
+    width  = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+    levels++;
+  }
+
+  return levels;
+}
+
+static U64
+texture_level_size(U32 width, U32 height, U32 kind)
+{
+  return (U64)((width + 3) / 4) * ((height + 3) / 4) * texture_kind_block_size(kind);
+}
+
+B32
+texture_cache_load(TextureCache *cache, const char *image_path, U32 kind)
+{
+  MemoryZero(cache, sizeof(TextureCache));
+
+  FileProperties source = os_file_properties(image_path);
+  if (!source.exists) {
+    return 0;
+  }
+
+  char path[512];
+  texture_cache_path(path, sizeof(path), image_path, kind);
+
+  if (!os_file_map(&cache->file, path)) {
+    return 0;
+  }
+
+  TextureCacheHeader *header = (TextureCacheHeader *)cache->file.data;
+
+  B32 valid = cache->file.size >= sizeof(TextureCacheHeader) && header->magic == TEXTURE_CACHE_MAGIC &&
+              header->version == TEXTURE_CACHE_VERSION && header->kind == kind && header->mip_levels <= TEXTURE_LEVEL_MAX &&
+              header->source_path_hash == hash_fnv1a(image_path, strlen(image_path)) && header->source_size == source.size &&
+              header->source_modified == source.modified && header->data_size == cache->file.size - sizeof(TextureCacheHeader);
+
+  if (!valid) {
+    log_dev("Texture cache is stale: %s", path);
+    os_file_unmap(&cache->file);
+    return 0;
+  }
+
+  cache->data       = (U8 *)(header + 1);
+  cache->size       = header->data_size;
+  cache->format     = g_texture_cache_formats[kind];
+  cache->width      = header->width;
+  cache->height     = header->height;
+  cache->mip_levels = header->mip_levels;
+
+  U64 offset = 0;
+  for (U32 level = 0; level < cache->mip_levels; ++level) {
+    cache->level_offsets[level] = offset;
+    offset += texture_level_size(Max(cache->width >> level, 1), Max(cache->height >> level, 1), kind);
+  }
+
+  if (offset != cache->size) {
+    log_dev("Texture cache is stale: %s", path);
+    texture_cache_free(cache);
+    return 0;
+  }
+
+  return 1;
+}
+
+void
+texture_cache_free(TextureCache *cache)
+{
+  free(cache->decoded);
+  os_file_unmap(&cache->file);
+  MemoryZero(cache, sizeof(TextureCache));
+}
+
+// --- KTX2 ---
+// Only 2D textures without array layers or faces. Levels are uploaded as stored, a level count of 0 (generate mips)
+// loads level 0 alone. Of the supercompression schemes only zlib is supported, stb_image already carries an inflater.
+
+#define KTX2_SUPERCOMPRESSION_NONE 0
+#define KTX2_SUPERCOMPRESSION_ZLIB 3
+
+typedef struct Ktx2Header Ktx2Header;
+typedef struct Ktx2Level  Ktx2Level;
+
+struct Ktx2Header {
+  U8  identifier[12];
+  U32 vk_format;
+  U32 type_size;
+  U32 pixel_width;
+  U32 pixel_height;
+  U32 pixel_depth;
+  U32 layer_count;
+  U32 face_count;
+  U32 level_count;
+  U32 supercompression_scheme;
+  U32 dfd_byte_offset;
+  U32 dfd_byte_length;
+  U32 kvd_byte_offset;
+  U32 kvd_byte_length;
+  U64 sgd_byte_offset;
+  U64 sgd_byte_length;
+};
+
+struct Ktx2Level {
+  U64 byte_offset;
+  U64 byte_length;
+  U64 uncompressed_byte_length;
+};
+
+static const U8 g_ktx2_identifier[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+
+// Bytes per block of the formats a KTX2 file can be loaded with, block_extent is 4 for the block compressed ones and 1
+// otherwise. Returns 0 for formats whose level sizes aren't known here, those files are rejected.
+static U32
+texture_format_block_bytes(VkFormat format, U32 *block_extent)
+{
+  *block_extent = 4;
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+  case VK_FORMAT_BC4_SNORM_BLOCK:
+    return 8;
+  case VK_FORMAT_BC2_UNORM_BLOCK:
+  case VK_FORMAT_BC2_SRGB_BLOCK:
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+  case VK_FORMAT_BC5_SNORM_BLOCK:
+  case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+  case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    return 16;
+  default:
+    break;
+  }
+
+  *block_extent = 1;
+  switch (format) {
+  case VK_FORMAT_R8_UNORM:
+    return 1;
+  case VK_FORMAT_R8G8_UNORM:
+    return 2;
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_B8G8R8A8_UNORM:
+  case VK_FORMAT_B8G8R8A8_SRGB:
+    return 4;
+  case VK_FORMAT_R16G16B16A16_SFLOAT:
+    return 8;
+  case VK_FORMAT_R32G32B32A32_SFLOAT:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+B32
+texture_cache_load_ktx2(TextureCache *cache, const char *path)
+{
+  MemoryZero(cache, sizeof(TextureCache));
+
+  if (!os_file_map(&cache->file, path)) {
+    log_dev("Failed to open KTX2 file: %s", path);
+    return 0;
+  }
+
+  Ktx2Header *header = (Ktx2Header *)cache->file.data;
+  Ktx2Level  *levels = (Ktx2Level *)(header + 1);
+  U32         count  = cache->file.size >= sizeof(Ktx2Header) ? Max(header->level_count, 1) : 0;
+
+  B32 valid = count > 0 && memcmp(header->identifier, g_ktx2_identifier, sizeof(g_ktx2_identifier)) == 0;
+  valid     = valid && header->vk_format != VK_FORMAT_UNDEFINED && header->pixel_width > 0 && header->pixel_height > 0;
+  valid     = valid && header->pixel_depth == 0 && header->layer_count <= 1 && header->face_count == 1 && count <= TEXTURE_LEVEL_MAX;
+  valid     = valid && (header->supercompression_scheme == KTX2_SUPERCOMPRESSION_NONE ||
+                    header->supercompression_scheme == KTX2_SUPERCOMPRESSION_ZLIB);
+  valid     = valid && cache->file.size >= sizeof(Ktx2Header) + count * sizeof(Ktx2Level);
+  valid     = valid && count <= texture_mip_levels(header->pixel_width, header->pixel_height);
+
+  U32 block_extent = 0;
+  U32 block_bytes  = valid ? texture_format_block_bytes((VkFormat)header->vk_format, &block_extent) : 0;
+  valid            = valid && block_bytes > 0;
+
+  // every level has to hold at least the texels the upload copies out of it, and lie inside the file
+  for (U32 level = 0; valid && level < count; ++level) {
+    Ktx2Level *l        = &levels[level];
+    U64        width    = Max(header->pixel_width >> level, 1);
+    U64        height   = Max(header->pixel_height >> level, 1);
+    U64        expected = ((width + block_extent - 1) / block_extent) * ((height + block_extent - 1) / block_extent) * block_bytes;
+
+    valid = l->byte_length > 0 && l->byte_offset <= cache->file.size && l->byte_length <= cache->file.size - l->byte_offset;
+    if (header->supercompression_scheme == KTX2_SUPERCOMPRESSION_ZLIB) {
+      // stb_image inflates with int sizes
+      valid = valid && l->uncompressed_byte_length >= expected && l->uncompressed_byte_length <= (U64)max_S32 &&
+              l->byte_length <= (U64)max_S32;
+    } else {
+      valid = valid && l->byte_length >= expected;
+    }
+  }
+
+  if (!valid) {
+    log_dev("Unsupported or broken KTX2 file: %s", path);
+    texture_cache_free(cache);
+    return 0;
+  }
+
+  cache->format     = (VkFormat)header->vk_format;
+  cache->width      = header->pixel_width;
+  cache->height     = header->pixel_height;
+  cache->mip_levels = count;
+
+  if (header->supercompression_scheme == KTX2_SUPERCOMPRESSION_NONE) {
+    // the levels are stored smallest first and back to back, so the whole range goes up in one copy
+    U64 begin = max_U64;
+    U64 end   = 0;
+    for (U32 level = 0; level < count; ++level) {
+      begin = Min(begin, levels[level].byte_offset);
+      end   = Max(end, levels[level].byte_offset + levels[level].byte_length);
+    }
+
+    cache->data = (U8 *)cache->file.data + begin;
+    cache->size = end - begin;
+    for (U32 level = 0; level < count; ++level) {
+      cache->level_offsets[level] = levels[level].byte_offset - begin;
+    }
+
+    return 1;
+  }
+
+  // inflate every level into one buffer, each level starts 16 byte aligned which is a multiple of every block size
+  U64 size = 0;
+  for (U32 level = 0; level < count; ++level) {
+    cache->level_offsets[level] = size;
+    size += AlignPow2(levels[level].uncompressed_byte_length, 16);
+  }
+
+  cache->decoded = (U8 *)malloc(size);
+  cache->data    = cache->decoded;
+  cache->size    = size;
+
+  for (U32 level = 0; level < count; ++level) {
+    Ktx2Level *l       = &levels[level];
+    char      *src     = (char *)cache->file.data + l->byte_offset;
+    char      *dst     = (char *)cache->decoded + cache->level_offsets[level];
+    S32        written = stbi_zlib_decode_buffer(dst, (S32)l->uncompressed_byte_length, src, (S32)l->byte_length);
+
+    if (written != (S32)l->uncompressed_byte_length) {
+      log_dev("Failed to inflate level %u of KTX2 file: %s", level, path);
+      texture_cache_free(cache);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// --- Block encoding ---
+// Endpoints are the bounding box of the block, indices pick the closest palette entry. BC1 insets the box by 1/16 of its
+// extent since it only has four colors, BC4 has eight values and keeps the extremes.
+// This is the usual real time encoder (van Waveren), good enough for cooking and fast enough to run at load time.
+
+static U16
+bc1_pack_565(S32 r, S32 g, S32 b)
+{
+  return (U16)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+static void
+bc1_unpack_565(U16 c, S32 *rgb)
+{
+  S32 r  = (c >> 11) & 31;
+  S32 g  = (c >> 5) & 63;
+  S32 b  = c & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+// texels are 16 rgba values in row order
+static void
+bc1_encode_block(U8 *texels, U8 *dst)
+{
+  S32 lo[3] = {255, 255, 255};
+  S32 hi[3] = {0, 0, 0};
+
+  for (U32 i = 0; i < 16; ++i) {
+    for (U32 c = 0; c < 3; ++c) {
+      lo[c] = Min(lo[c], texels[i * 4 + c]);
+      hi[c] = Max(hi[c], texels[i * 4 + c]);
+    }
+  }
+
+  for (U32 c = 0; c < 3; ++c) {
+    S32 inset = (hi[c] - lo[c]) >> 4;
+    lo[c] += inset;
+    hi[c] -= inset;
+  }
+
+  U16 c0 = bc1_pack_565(hi[0], hi[1], hi[2]);
+  U16 c1 = bc1_pack_565(lo[0], lo[1], lo[2]);
+
+  // c0 > c1 selects the four color mode, equal endpoints only ever need index 0
+  if (c0 < c1) {
+    U16 t = c0;
+    c0    = c1;
+    c1    = t;
+  }
+
+  S32 palette[4][3];
+  bc1_unpack_565(c0, palette[0]);
+  bc1_unpack_565(c1, palette[1]);
+  for (U32 c = 0; c < 3; ++c) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+
+  U32 indices = 0;
+  if (c0 != c1) {
+    for (U32 i = 0; i < 16; ++i) {
+      U32 best          = 0;
+      S32 best_distance = max_S32;
+
+      for (U32 p = 0; p < 4; ++p) {
+        S32 distance = 0;
+        for (U32 c = 0; c < 3; ++c) {
+          S32 d = texels[i * 4 + c] - palette[p][c];
+          distance += d * d;
+        }
+
+        if (distance < best_distance) {
+          best          = p;
+          best_distance = distance;
+        }
+      }
+
+      indices |= best << (i * 2);
+    }
+  }
+
+  dst[0] = (U8)(c0 & 0xff);
+  dst[1] = (U8)(c0 >> 8);
+  dst[2] = (U8)(c1 & 0xff);
+  dst[3] = (U8)(c1 >> 8);
+  MemoryCopy(dst + 4, &indices, 4);
+}
+
+// encodes one channel of 16 rgba texels
+static void
+bc4_encode_block(U8 *texels, U32 channel, U8 *dst)
+{
+  S32 lo = 255;
+  S32 hi = 0;
+
+  for (U32 i = 0; i < 16; ++i) {
+    lo = Min(lo, texels[i * 4 + channel]);
+    hi = Max(hi, texels[i * 4 + channel]);
+  }
+
+  // a0 > a1 selects the eight value mode
+  S32 palette[8];
+  palette[0] = hi;
+  palette[1] = lo;
+  for (S32 p = 1; p < 7; ++p) {
+    palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+  }
+
+  U64 indices = 0;
+  if (hi != lo) {
+    for (U32 i = 0; i < 16; ++i) {
+      U64 best          = 0;
+      S32 best_distance = max_S32;
+
+      for (U32 p = 0; p < 8; ++p) {
+        S32 distance = texels[i * 4 + channel] - palette[p];
+        distance     = distance < 0 ? -distance : distance;
+
+        if (distance < best_distance) {
+          best          = p;
+          best_distance = distance;
+        }
+      }
+
+      indices |= best << (i * 3);
+    }
+  }
+
+  dst[0] = (U8)hi;
+  dst[1] = (U8)lo;
+  for (U32 i = 0; i < 6; ++i) {
+    dst[2 + i] = (U8)(indices >> (i * 8));
+  }
+}
+
+static void
+texture_encode_level(U8 *pixels, U32 width, U32 height, U32 kind, U8 *dst)
+{
+  U32 block_size = texture_kind_block_size(kind);
+
+  for (U32 by = 0; by < height; by += 4) {
+    for (U32 bx = 0; bx < width; bx += 4) {
+      // edge blocks repeat the last row and column
+      U8 texels[16 * 4];
+      for (U32 y = 0; y < 4; ++y) {
+        for (U32 x = 0; x < 4; ++x) {
+          U32 sx = Min(bx + x, width - 1);
+          U32 sy = Min(by + y, height - 1);
+          MemoryCopy(&texels[(y * 4 + x) * 4], &pixels[((U64)sy * width + sx) * 4], 4);
+        }
+      }
+
+      if (kind == TEXTURE_KIND_COLOR) {
+        bc1_encode_block(texels, dst);
+      } else if (kind == TEXTURE_KIND_SCALAR) {
+        bc4_encode_block(texels, 0, dst);
+      } else {
+        bc4_encode_block(texels, 0, dst);
+        bc4_encode_block(texels, 1, dst + 8);
+      }
+
+      dst += block_size;
+    }
+  }
+}
+
+static F32
+srgb_to_linear(F32 f)
+{
+  return f <= 0.04045f ? f / 12.92f : powf((f + 0.055f) / 1.055f, 2.4f);
+}
+
+static U8
+linear_to_srgb(F32 f)
+{
+  f = f <= 0.0031308f ? f * 12.92f : 1.055f * powf(f, 1.0f / 2.4f) - 0.055f;
+  return (U8)Clamp(0.0f, f * 255.0f + 0.5f, 255.0f);
+}
+
+// 2x2 box filter, odd sizes clamp at the edge. Colors are averaged in linear space and normals are renormalized.
+// to_linear maps a byte to [0, 1], through the srgb curve for colors.
+static void
+texture_downsample(U8 *src, U32 width, U32 height, U8 *dst, U32 dst_width, U32 dst_height, U32 kind, F32 *to_linear)
+{
+  for (U32 y = 0; y < dst_height; ++y) {
+    for (U32 x = 0; x < dst_width; ++x) {
+      U32 x0 = Min(x * 2, width - 1);
+      U32 x1 = Min(x * 2 + 1, width - 1);
+      U32 y0 = Min(y * 2, height - 1);
+      U32 y1 = Min(y * 2 + 1, height - 1);
+
+      U8 *s[4] = {
+          &src[((U64)y0 * width + x0) * 4],
+          &src[((U64)y0 * width + x1) * 4],
+          &src[((U64)y1 * width + x0) * 4],
+          &src[((U64)y1 * width + x1) * 4],
+      };
+
+      F32 sum[4] = {0};
+      for (U32 i = 0; i < 4; ++i) {
+        for (U32 c = 0; c < 4; ++c) {
+          sum[c] += c < 3 ? to_linear[s[i][c]] : s[i][c] / 255.0f;
+        }
+      }
+
+      F32 v[4] = {sum[0] * 0.25f, sum[1] * 0.25f, sum[2] * 0.25f, sum[3] * 0.25f};
+
+      if (kind == TEXTURE_KIND_NORMAL) {
+        F32 n[3]   = {v[0] * 2.0f - 1.0f, v[1] * 2.0f - 1.0f, v[2] * 2.0f - 1.0f};
+        F32 length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f) {
+          for (U32 c = 0; c < 3; ++c) {
+            v[c] = n[c] / length * 0.5f + 0.5f;
+          }
+        }
+      }
+
+      U8 *d = &dst[((U64)y * dst_width + x) * 4];
+      for (U32 c = 0; c < 4; ++c) {
+        d[c] = (kind == TEXTURE_KIND_COLOR && c < 3) ? linear_to_srgb(v[c]) : (U8)Clamp(0.0f, v[c] * 255.0f + 0.5f, 255.0f);
+      }
+    }
+  }
+}
+
+// Encodes the rgba pixels with their whole mip chain and writes the cache, safe to call from worker threads
+// as long as no two threads cook the same image and kind.
+void
+texture_cache_write(const char *image_path, U32 kind, U8 *pixels, U32 width, U32 height)
+{
+  ProfileZone zone = profile_zone_begin("texture_cook");
+
+  FileProperties source = os_file_properties(image_path);
+  if (!source.exists) {
+    profile_zone_end(&zone);
+    return;
+  }
+
+  Temp scratch = scratch_begin(0, 0);
+
+  U32 mip_levels = Min(texture_mip_levels(width, height), TEXTURE_LEVEL_MAX);
+
+  U64 data_size = 0;
+  for (U32 level = 0; level < mip_levels; ++level) {
+    data_size += texture_level_size(Max(width >> level, 1), Max(height >> level, 1), kind);
+  }
+
+  U8 *data = push_array_no_zero(scratch.arena, U8, data_size);
+  U8 *dst  = data;
+
+  F32 to_linear[256];
+  for (U32 i = 0; i < 256; ++i) {
+    to_linear[i] = kind == TEXTURE_KIND_COLOR ? srgb_to_linear(i / 255.0f) : i / 255.0f;
+  }
+
+  // the levels below 0 ping pong between two buffers of the size of level 1
+  U64 mip_size = (U64)Max(width / 2, 1) * Max(height / 2, 1) * 4;
+  U8 *mips[2]  = {push_array_no_zero(scratch.arena, U8, mip_size), push_array_no_zero(scratch.arena, U8, mip_size)};
+
+  U8 *level_pixels = pixels;
+  U32 w            = width;
+  U32 h            = height;
+
+  for (U32 level = 0; level < mip_levels; ++level) {
+    texture_encode_level(level_pixels, w, h, kind, dst);
+    dst += texture_level_size(w, h, kind);
+
+    if (level + 1 < mip_levels) {
+      U32 next_w = Max(w / 2, 1);
+      U32 next_h = Max(h / 2, 1);
+      U8 *next   = mips[level % 2];
+
+      texture_downsample(level_pixels, w, h, next, next_w, next_h, kind, to_linear);
+
+      level_pixels = next;
+      w            = next_w;
+      h            = next_h;
+    }
+  }
+
+  char path[512];
+  texture_cache_path(path, sizeof(path), image_path, kind);
+
+  FILE *f = fopen(path, "wb");
+  if (f) {
+    TextureCacheHeader header = {0};
+    header.magic              = TEXTURE_CACHE_MAGIC;
+    header.version            = TEXTURE_CACHE_VERSION;
+    header.source_path_hash   = hash_fnv1a(image_path, strlen(image_path));
+    header.source_size        = source.size;
+    header.source_modified    = source.modified;
+    header.kind               = kind;
+    header.width              = width;
+    header.height             = height;
+    header.mip_levels         = mip_levels;
+    header.data_size          = data_size;
+
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(data, 1, data_size, f);
+    fclose(f);
+  } else {
+    log_dev("Failed to write texture cache: %s", path);
+  }
+
+  scratch_end(scratch);
+  profile_zone_end(&zone);
+}
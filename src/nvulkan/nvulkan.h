@@ -8,6 +8,7 @@
 #include <GLFW/glfw3.h>
 
 #include "base/base.h"
+#include "base/base_arena.h"
 
 C_LINKAGE_BEGIN
 
@@ -17,21 +18,105 @@ C_LINKAGE_BEGIN
     exit(1);                                                                                                                               \
   }
 
-typedef struct Device         Device;
-typedef struct Swapchain      Swapchain;
-typedef struct Image          Image;
-typedef struct Texture        Texture;
-typedef struct Framebuffers   Framebuffers;
-typedef struct CommandBuffers CommandBuffers;
-typedef struct DescriptorSet  DescriptorSet;
-typedef struct Shader         Shader;
-typedef struct Pipeline       Pipeline;
-typedef struct Buffer         Buffer;
+typedef struct MemoryRange      MemoryRange;
+typedef struct MemoryBlock      MemoryBlock;
+typedef struct MemoryPool       MemoryPool;
+typedef struct MemoryAllocator  MemoryAllocator;
+typedef struct MemoryAllocation MemoryAllocation;
+typedef struct MemoryStats      MemoryStats;
+typedef struct Device           Device;
+typedef struct Swapchain        Swapchain;
+typedef struct Image            Image;
+typedef struct Texture          Texture;
+typedef struct Framebuffers     Framebuffers;
+typedef struct CommandBuffers   CommandBuffers;
+typedef struct DescriptorSet    DescriptorSet;
+typedef struct Shader           Shader;
+typedef struct Pipeline         Pipeline;
+typedef struct Buffer           Buffer;
+typedef struct UploaderMips     UploaderMips;
+typedef struct Uploader         Uploader;
+typedef struct Frame            Frame;
+typedef struct Frames           Frames;
+typedef struct GpuProfilerPass  GpuProfilerPass;
+typedef struct GpuProfilerSlot  GpuProfilerSlot;
+typedef struct GpuProfiler      GpuProfiler;
+typedef struct GpuProfilerStats GpuProfilerStats;
+
+// Device memory is allocated in large blocks per memory type and handed out as sub ranges.
+// Buffers and optimal tiling images live in different pools, so bufferImageGranularity never matters.
+#define MEMORY_BLOCK_SIZE             MB(64)
+#define MEMORY_SMALL_HEAP_SIZE        GB(1)
+#define MEMORY_POOL_KIND_COUNT        2
+#define MEMORY_DEDICATED_THRESHOLD(b) ((b) / 2)
+
+struct MemoryRange {
+  VkDeviceSize offset;
+  VkDeviceSize size;
+};
+
+struct MemoryBlock {
+  VkDeviceMemory memory;
+  VkDeviceSize   size;
+  VkDeviceSize   used;
+  U8            *mapped; // persistently mapped if the memory type is host visible
+  U32            memory_type_index;
+  B32            linear;
+  B32            dedicated;
+  U32            allocation_count;
+
+  // free ranges sorted by offset, neighbours are always coalesced
+  MemoryRange *free_ranges;
+  U32          free_range_count;
+  U32          free_range_capacity;
+};
+
+struct MemoryPool {
+  MemoryBlock **blocks;
+  U32           block_count;
+  U32           block_capacity;
+  U32           memory_type_index;
+  B32           linear;
+};
+
+struct MemoryAllocator {
+  VkDevice                         device;
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  MemoryPool                       pools[VK_MAX_MEMORY_TYPES][MEMORY_POOL_KIND_COUNT];
+};
+
+struct MemoryAllocation {
+  VkDeviceMemory memory;
+  VkDeviceSize   offset;
+  VkDeviceSize   size;
+  U8            *mapped;
+  MemoryBlock   *block;
+};
 
+struct MemoryStats {
+  U64 block_count;
+  U64 dedicated_block_count;
+  U64 allocation_count;
+  U64 reserved_bytes;
+  U64 used_bytes;
+  U64 free_range_count;
+  U64 largest_free_range;
+  F32 fragmentation; // 1 - largest free range / free bytes, 0 means all free memory is in one piece
+};
+
+// transfer and compute queues are the graphics queue if the gpu has no separate family for them
 struct Device {
-  VkDevice handle;
-  VkQueue  graphics_queue;
-  uint32_t graphics_queue_index;
+  VkDevice        handle;
+  VkQueue         graphics_queue;
+  uint32_t        graphics_queue_index;
+  VkQueue         transfer_queue;
+  uint32_t        transfer_queue_index;
+  VkQueue         compute_queue;
+  uint32_t        compute_queue_index;
+  VkPipelineCache pipeline_cache;
+  MemoryAllocator allocator;
+  B32             texture_compression_bc; // BC1-7 formats can be sampled
+  B32             multi_draw_indirect;    // one indirect draw takes many commands, each with its own first instance
 };
 
 struct Swapchain {
@@ -42,26 +127,24 @@ struct Swapchain {
   VkSurfaceFormatKHR format;
 
   U32 image_count;
-  U32 semaphore_count;
 
   VkImage              *images;
   VkImageView          *image_views;
   VkImageMemoryBarrier *barriers;
-  VkSemaphore          *read_semaphores;
-  VkSemaphore          *write_semaphores;
-  VkFence              *fences;
+  VkSemaphore          *render_finished; // per image, signaled by the frame submit and waited on by present
+  VkFence              *image_fences;    // fence of the frame that last rendered to the image, not owned
 
   U32 width;
   U32 height;
-  U32 current_semaphore;
   U32 current_image;
 };
 
 struct Image {
-  VkImage        handle;
-  VkImageView    view;
-  VkDeviceMemory memory;
-  VkFormat       format;
+  VkImage          handle;
+  VkImageView      view;
+  MemoryAllocation allocation;
+  VkFormat         format;
+  U32              mip_levels;
 };
 
 struct Texture {
@@ -102,8 +185,132 @@ struct Pipeline {
 };
 
 struct Buffer {
-  VkBuffer       handle;
-  VkDeviceMemory memory;
+  VkBuffer         handle;
+  MemoryAllocation allocation;
+};
+
+// an uploaded image whose mip chain still has to be blitted down from level 0 on the graphics queue
+struct UploaderMips {
+  VkImage image;
+  U32     width;
+  U32     height;
+  U32     mip_levels;
+};
+
+// Batches uploads into one command buffer. Data is staged in a persistent host visible ring, uploader_flush submits
+// the batch with a fence and the next upload only waits for it when the ring and command buffer are needed again.
+// The ring is not reused while a batch is in flight, running out of it flushes and waits for the whole batch.
+// With a separate transfer queue family the copies run there and ownership is handed to the graphics queue
+// (release on transfer, acquire on graphics behind a semaphore), so uploads overlap with rendering.
+struct Uploader {
+  Device         *ldevice;
+  VkCommandPool   cmd_pool;
+  VkCommandBuffer cmd_buf;
+  VkFence         fence;
+  Buffer          ring;
+  VkDeviceSize    ring_size;
+  VkDeviceSize    ring_head;
+  B32             recording;
+  B32             in_flight;
+  U32             copy_count;
+
+  B32             separate;
+  VkCommandPool   acquire_cmd_pool;
+  VkCommandBuffer acquire_cmd_buf;
+  VkSemaphore     semaphore;
+
+  // ownership transfers and final layout transitions of the batch
+  VkBufferMemoryBarrier *buffer_barriers;
+  U32                    buffer_barrier_count;
+  U32                    buffer_barrier_capacity;
+  VkImageMemoryBarrier  *image_barriers;
+  U32                    image_barrier_count;
+  U32                    image_barrier_capacity;
+
+  // transfer queues can't blit, so with a separate queue mip chains are generated after the acquire
+  UploaderMips *mips;
+  U32           mip_count;
+  U32           mip_capacity;
+
+  // uploads bigger than the ring get their own staging buffer which is freed with the batch
+  Buffer      *overflow;
+  U32          overflow_count;
+  U32          overflow_capacity;
+  VkDeviceSize overflow_size; // bytes staged in overflow buffers, for the log
+};
+
+// CPU side frames, decoupled from the swapchain images. Recording frame N + 1 overlaps with the gpu executing frame N,
+// the count is the latency depth: the cpu waits once it is count frames ahead of the gpu.
+#define FRAMES_IN_FLIGHT_MAX     4
+#define FRAMES_IN_FLIGHT_DEFAULT 2
+#define FRAME_ARENA_RESERVE_SIZE MB(64)
+#define FRAME_STAGING_SIZE       MB(4)
+#define FRAME_UNIFORM_SIZE       KB(64)
+
+struct Frame {
+  VkCommandPool   cmd_pool;
+  VkCommandBuffer cmd_buf;
+  VkFence         fence;           // signaled when the gpu is done with the frame
+  VkSemaphore     image_available; // signaled by acquire, waited on by the frame submit
+  Arena          *arena;           // transient allocations, cleared when the frame slot is reused
+  Buffer          staging;         // host visible source for per frame copies, reused with the slot
+  VkDeviceSize    staging_head;
+  U8             *uniform_data;    // this slot's slice of Frames.uniforms, written directly by the cpu
+  VkDeviceSize    uniform_base;    // slice offset in Frames.uniforms
+  VkDeviceSize    uniform_head;
+  VkDeviceSize    uniform_alignment;
+};
+
+struct Frames {
+  Frame  frames[FRAMES_IN_FLIGHT_MAX];
+  U32    count;
+  U32    index;
+  U64    number;
+  Buffer uniforms; // one FRAME_UNIFORM_SIZE slice per frame, bound as dynamic uniform buffer
+};
+
+// Timestamp queries around passes. Every frame slot owns a range of queries, the results are read when the slot comes
+// around again (its fence signaled), so reading never stalls. Passes are identified by name and keep a rolling history.
+#define GPU_PROFILER_PASS_MAX    16
+#define GPU_PROFILER_MARKER_MAX  32
+#define GPU_PROFILER_HISTORY_MAX 256
+
+struct GpuProfilerPass {
+  const char *name;
+  F32         history[GPU_PROFILER_HISTORY_MAX]; // milliseconds
+  U32         history_count;
+  U32         history_head;
+};
+
+struct GpuProfilerSlot {
+  U64 frame;
+  U32 marker_count;
+  U32 marker_passes[GPU_PROFILER_MARKER_MAX];
+  B32 pending;
+};
+
+struct GpuProfiler {
+  VkQueryPool     query_pool;
+  B32             supported;
+  F64             timestamp_period; // nanoseconds per tick
+  U64             timestamp_mask;
+  U32             slot_count;
+  U32             slot;
+  GpuProfilerSlot slots[FRAMES_IN_FLIGHT_MAX];
+  GpuProfilerPass passes[GPU_PROFILER_PASS_MAX];
+  U32             pass_count;
+
+  // optional, if set the gpu time from the first to the last marker of frame n is stored in frame_times[n]
+  F32 *frame_times;
+  U64  frame_time_count;
+};
+
+struct GpuProfilerStats {
+  F32 min;
+  F32 avg;
+  F32 p99;
+  F32 last;
+  U32 count;
 };
 
 VkInstance vulkan_instance_create(const char *name, int version, const char **extensions, U32 extension_count, const char **layers,
@@ -119,13 +326,39 @@ Device logical_device_create(VkSurfaceKHR surface, VkPhysicalDevice pdevice, con
                              const char **layers, U32 layer_count);
 void   logical_device_destroy(Device *ldevice);
 
+void pipeline_cache_create(Device *ldevice, VkPhysicalDevice pdevice, const char *path);
+void pipeline_cache_destroy(Device *ldevice, VkPhysicalDevice pdevice, const char *path);
+
 Swapchain swapchain_create(U32 image_count, VkSurfaceKHR surface, VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool);
 void      swapchain_update(Swapchain *sc, VkCommandPool cmd_pool, B8 vsync);
 void      swapchain_destroy(Swapchain *sc);
-U32       swapchain_acquire(Swapchain *sc);
-void      swapchain_present(Swapchain *sc, CommandBuffers *cmd_bufs);
-
-VkCommandPool command_pool_create(Device *ldevice);
+U32       swapchain_acquire(Swapchain *sc, Frame *frame);
+void      swapchain_present(Swapchain *sc, Frame *frame);
+
+Frames frames_create(VkPhysicalDevice pdevice, Device *ldevice, U32 count);
+void   frames_destroy(Frames *frames, Device *ldevice);
+Frame *frames_begin(Frames *frames, Device *ldevice);
+void   frames_submit(Frame *frame, Device *ldevice);
+void   frames_end(Frames *frames);
+void  *frame_stage(Frame *frame, VkDeviceSize size, VkDeviceSize *offset);
+U32    frame_push_uniforms(Frame *frame, void *data, VkDeviceSize size);
+
+GpuProfiler gpu_profiler_create(VkPhysicalDevice pdevice, Device *ldevice, U32 slot_count);
+void        gpu_profiler_destroy(GpuProfiler *p, Device *ldevice);
+void        gpu_profiler_begin_frame(GpuProfiler *p, Device *ldevice, VkCommandBuffer cmd_buf, U32 slot, U64 frame);
+U32         gpu_profiler_begin(GpuProfiler *p, VkCommandBuffer cmd_buf, const char *name);
+void        gpu_profiler_end(GpuProfiler *p, VkCommandBuffer cmd_buf, U32 marker);
+void        gpu_profiler_collect(GpuProfiler *p, Device *ldevice);
+void        gpu_profiler_pass_stats(GpuProfiler *p, U32 pass, GpuProfilerStats *stats);
+
+void             memory_allocator_init(MemoryAllocator *allocator, VkPhysicalDevice pdevice, VkDevice device);
+void             memory_allocator_release(MemoryAllocator *allocator);
+MemoryAllocation memory_alloc(MemoryAllocator *allocator, VkMemoryRequirements *reqs, VkMemoryPropertyFlags properties, B32 linear);
+void             memory_free(MemoryAllocator *allocator, MemoryAllocation *allocation);
+void             memory_allocator_stats(MemoryAllocator *allocator, MemoryStats *type_stats, MemoryStats *total);
+void             memory_allocator_dump(MemoryAllocator *allocator);
+
+VkCommandPool command_pool_create(Device *ldevice, U32 queue_family_index);
 void          command_pool_destroy(VkCommandPool cmd_pool, Device *ldevice);
 
 VkCommandBuffer command_buffer_allocate(Device *ldevice, VkCommandPool cmd_pool);
@@ -142,53 +375,59 @@ Image image_create(U32 width, U32 height, VkFormat format, U32 mip_levels, VkIma
 void  image_destroy(Image *image, Device *ldevice);
 Image image_create_depth(VkPhysicalDevice pdevice, Device *ldevice, Swapchain *sc, VkCommandPool cmd_pool);
 
+VkFormat image_find_depth_format(VkPhysicalDevice pdevice);
+
 Texture texture_create(U32 width, U32 height, VkFormat format, VkImageAspectFlags aspect_mask, VkImageUsageFlags usage,
                        VkPhysicalDevice pdevice, Device *ldevice);
 Texture texture_from_pixels(U32 width, U32 height, U32 channels, VkFormat format, U8 *pixels, VkSamplerCreateInfo sampler_info,
-                            VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool);
+                            VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader);
+Texture texture_from_levels(U32 width, U32 height, U32 mip_levels, VkFormat format, U8 *data, VkDeviceSize size,
+                            VkDeviceSize *level_offsets, VkSamplerCreateInfo sampler_info, VkPhysicalDevice pdevice, Device *ldevice,
+                            Uploader *uploader);
 void    texture_destroy(Texture *t, Device *ldevice);
 
 void image_transition_layout(Image *image, VkImageLayout old_layout, VkImageLayout new_layout, VkImageAspectFlags aspect_mask,
                              VkCommandBuffer cmd_buf);
+void image_copy_to_buffer(VkCommandBuffer cmd_buf, Image *image, VkImageLayout layout, U32 width, U32 height, Buffer *dst);
 
 VkRenderPass render_pass_create_present(VkFormat color_format, VkFormat depth_format, Device *ldevice);
 VkRenderPass render_pass_create_offscreen(VkFormat color_format, VkFormat depth_format, Device *ldevice);
 void         render_pass_destroy(VkRenderPass render_pass, Device *ldevice);
 
-VkFramebuffer frame_buffer_create(Swapchain *sc, VkRenderPass render_pass, VkImageView color_view, VkImageView depth_view);
+VkFramebuffer frame_buffer_create(Device *ldevice, VkRenderPass render_pass, VkImageView color_view, VkImageView depth_view, U32 width,
+                                  U32 height);
 void          frame_buffer_destroy(VkFramebuffer framebuffer, Device *ldevice);
 
 Framebuffers frame_buffers_create(Swapchain *sc, VkRenderPass render_pass, Image *depth_image);
 void         frame_buffers_destroy(Framebuffers *framebuffers, Device *ldevice);
 
 DescriptorSet descriptor_set_create(VkDescriptorSetLayoutBinding *bindings, U32 binding_count, Device *ldevice);
+DescriptorSet descriptor_set_create_indexed(VkDescriptorSetLayoutBinding *bindings, VkDescriptorBindingFlags *binding_flags,
+                                            U32 binding_count, U32 variable_count, Device *ldevice);
 void          descriptor_set_destroy(DescriptorSet *descriptor_set, Device *ldevice);
 
-Pipeline pipeline_create(Device *ldevice, DescriptorSet *desc_set, VkRenderPass render_pass, Shader *shaders, U32 shader_count,
+Pipeline pipeline_create(Device *ldevice, DescriptorSet *desc_sets, U32 desc_set_count, VkRenderPass render_pass, Shader *shaders,
+                         U32 shader_count,
                          VkVertexInputBindingDescription *binding_descriptions, U32 binding_description_count,
                          VkVertexInputAttributeDescription *attribute_descriptions, U32 attribute_description_count, U32 cull_mode);
 void     pipeline_destroy(Pipeline *pipeline, Device *ldevice);
 
-Buffer buffer_create(VkDeviceSize size, void *data, VkBufferUsageFlags usage, VkPhysicalDevice pdevice, Device *ldevice,
-                     VkCommandPool cmd_pool);
+Buffer buffer_create_device(VkDeviceSize size, VkBufferUsageFlags usage, VkPhysicalDevice pdevice, Device *ldevice);
 Buffer buffer_create_staging(VkDeviceSize size, void *data, VkPhysicalDevice pdevice, Device *ldevice);
+Buffer buffer_create_readback(VkDeviceSize size, VkPhysicalDevice pdevice, Device *ldevice);
+Buffer buffer_create_host(VkDeviceSize size, VkBufferUsageFlags usage, VkPhysicalDevice pdevice, Device *ldevice);
+void  *buffer_map(Buffer *buffer);
+void   buffer_copy(VkCommandBuffer cmd_buf, Buffer *dst, VkDeviceSize dst_offset, Buffer *src, VkDeviceSize src_offset, VkDeviceSize size);
 void   buffer_destroy(Buffer *buffer, Device *ldevice);
 
-// @Todo move somewhere
-static inline U32
-memory_type_find(VkPhysicalDevice pdevice, U32 type_bits, VkMemoryPropertyFlags flags)
-{
-  VkPhysicalDeviceMemoryProperties memory_properties;
-  vkGetPhysicalDeviceMemoryProperties(pdevice, &memory_properties);
-
-  for (U32 i = 0; i < memory_properties.memoryTypeCount; ++i) {
-    if ((type_bits & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & flags) == flags) {
-      return i;
-    }
-  }
-
-  // @Todo error handling
-  return 0;
-}
+Uploader uploader_create(Device *ldevice, VkDeviceSize ring_size);
+void     uploader_destroy(Uploader *up);
+void    *uploader_stage_buffer(Uploader *up, Buffer *dst, VkDeviceSize dst_offset, VkDeviceSize size);
+void     uploader_upload_buffer(Uploader *up, Buffer *dst, VkDeviceSize dst_offset, void *data, VkDeviceSize size);
+void     uploader_upload_image(Uploader *up, Image *dst, U32 width, U32 height, void *data, VkDeviceSize size);
+void     uploader_upload_image_levels(Uploader *up, Image *dst, U32 width, U32 height, void *data, VkDeviceSize size,
+                                      VkDeviceSize *level_offsets);
+void     uploader_flush(Uploader *up);
+void     uploader_wait(Uploader *up);
 
 C_LINKAGE_END
@@ -19,90 +19,82 @@ buffer_create_internal(VkDeviceSize size, VkBufferUsageFlags usage, VkPhysicalDe
   VkMemoryRequirements mem_reqs;
   vkGetBufferMemoryRequirements(ldevice->handle, buffer->handle, &mem_reqs);
 
-  VkMemoryAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-  alloc_info.allocationSize       = mem_reqs.size;
-  alloc_info.memoryTypeIndex      = memory_type_find(pdevice, mem_reqs.memoryTypeBits, properties);
+  buffer->allocation = memory_alloc(&ldevice->allocator, &mem_reqs, properties, 1);
 
-  if ((usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0) {
-    VkMemoryAllocateFlagsInfo alloc_flags = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
-    alloc_flags.flags                     = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
-
-    alloc_info.pNext = &alloc_flags;
-  }
-
-  VK_CHECK(vkAllocateMemory(ldevice->handle, &alloc_info, g_allocator, &buffer->memory) != VK_SUCCESS);
-
-  vkBindBufferMemory(ldevice->handle, buffer->handle, buffer->memory, 0);
+  VK_CHECK(vkBindBufferMemory(ldevice->handle, buffer->handle, buffer->allocation.memory, buffer->allocation.offset));
 }
 
-static void
-buffer_copy_internal(VkBuffer dst, VkBuffer src, VkDeviceSize size, Device *ldevice, VkCommandPool cmd_pool)
+Buffer
+buffer_create_device(VkDeviceSize size, VkBufferUsageFlags usage, VkPhysicalDevice pdevice, Device *ldevice)
 {
-  VkCommandBufferAllocateInfo info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-  info.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  info.commandPool                 = cmd_pool;
-  info.commandBufferCount          = 1;
-
-  VkCommandBuffer command_buffer;
-  vkAllocateCommandBuffers(ldevice->handle, &info, &command_buffer);
-
-  VkCommandBufferBeginInfo begin_info = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-  begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  Buffer buffer = {0};
 
-  vkBeginCommandBuffer(command_buffer, &begin_info);
+  buffer_create_internal(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, pdevice, ldevice, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer);
 
-  VkBufferCopy region;
-  region.srcOffset = 0;
-  region.dstOffset = 0;
-  region.size      = size;
-  vkCmdCopyBuffer(command_buffer, src, dst, 1, &region);
+  return buffer;
+}
 
-  vkEndCommandBuffer(command_buffer);
+// data can be null, then the caller fills the buffer through buffer_map
+Buffer
+buffer_create_staging(VkDeviceSize size, void *data, VkPhysicalDevice pdevice, Device *ldevice)
+{
+  Buffer buffer = {0};
 
-  VkSubmitInfo submit       = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-  submit.commandBufferCount = 1;
-  submit.pCommandBuffers    = &command_buffer;
+  buffer_create_internal(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, pdevice, ldevice,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer);
 
-  vkQueueSubmit(ldevice->graphics_queue, 1, &submit, VK_NULL_HANDLE);
-  vkQueueWaitIdle(ldevice->graphics_queue);
+  if (data) {
+    MemoryCopy(buffer_map(&buffer), data, size);
+  }
 
-  vkFreeCommandBuffers(ldevice->handle, cmd_pool, 1, &command_buffer);
+  return buffer;
 }
 
+// the gpu writes into it, the cpu reads through buffer_map after the copy finished
 Buffer
-buffer_create(VkDeviceSize size, void *data, VkBufferUsageFlags usage, VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool)
+buffer_create_readback(VkDeviceSize size, VkPhysicalDevice pdevice, Device *ldevice)
 {
-  Buffer buffer         = {0};
-  Buffer staging_buffer = buffer_create_staging(size, data, pdevice, ldevice);
-
-  buffer_create_internal(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, pdevice, ldevice, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer);
-
-  buffer_copy_internal(buffer.handle, staging_buffer.handle, size, ldevice, cmd_pool);
+  Buffer buffer = {0};
 
-  buffer_destroy(&staging_buffer, ldevice);
+  buffer_create_internal(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, pdevice, ldevice,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer);
 
   return buffer;
 }
 
+// the gpu reads it in place, for data that is rewritten every frame
 Buffer
-buffer_create_staging(VkDeviceSize size, void *data, VkPhysicalDevice pdevice, Device *ldevice)
+buffer_create_host(VkDeviceSize size, VkBufferUsageFlags usage, VkPhysicalDevice pdevice, Device *ldevice)
 {
   Buffer buffer = {0};
 
-  buffer_create_internal(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, pdevice, ldevice,
-                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer);
-
-  void *mapped;
-  vkMapMemory(ldevice->handle, buffer.memory, 0, size, 0, &mapped);
-  MemoryCopy(mapped, data, size);
-  vkUnmapMemory(ldevice->handle, buffer.memory);
+  buffer_create_internal(size, usage, pdevice, ldevice, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                         &buffer);
 
   return buffer;
 }
 
+// host visible blocks are persistently mapped, so this is just a pointer into the block
+void *
+buffer_map(Buffer *buffer)
+{
+  Assert(buffer->allocation.mapped);
+  return buffer->allocation.mapped;
+}
+
+void
+buffer_copy(VkCommandBuffer cmd_buf, Buffer *dst, VkDeviceSize dst_offset, Buffer *src, VkDeviceSize src_offset, VkDeviceSize size)
+{
+  VkBufferCopy region;
+  region.srcOffset = src_offset;
+  region.dstOffset = dst_offset;
+  region.size      = size;
+  vkCmdCopyBuffer(cmd_buf, src->handle, dst->handle, 1, &region);
+}
+
 void
 buffer_destroy(Buffer *buffer, Device *ldevice)
 {
   vkDestroyBuffer(ldevice->handle, buffer->handle, g_allocator);
-  vkFreeMemory(ldevice->handle, buffer->memory, g_allocator);
+  memory_free(&ldevice->allocator, &buffer->allocation);
 }
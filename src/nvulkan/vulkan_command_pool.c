@@ -4,10 +4,11 @@
 static VkAllocationCallbacks *g_allocator = 0;
 
 VkCommandPool
-command_pool_create(Device *ldevice)
+command_pool_create(Device *ldevice, U32 queue_family_index)
 {
   VkCommandPoolCreateInfo create_info = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
   create_info.flags                   = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  create_info.queueFamilyIndex        = queue_family_index;
 
   VkCommandPool cmd_pool;
   VK_CHECK(vkCreateCommandPool(ldevice->handle, &create_info, g_allocator, &cmd_pool));
@@ -1,25 +1,58 @@
 #include "nvulkan.h"
 
+#include "base/base_arena.h"
+
 // Keep this here so we know later where we have to use it
 static VkAllocationCallbacks *g_allocator = 0;
 
 DescriptorSet
 descriptor_set_create(VkDescriptorSetLayoutBinding *bindings, U32 binding_count, Device *ldevice)
+{
+  return descriptor_set_create_indexed(bindings, 0, binding_count, 0, ldevice);
+}
+
+// Descriptor indexing: binding_flags has one entry per binding (or is null). A binding with
+// VARIABLE_DESCRIPTOR_COUNT has to be the last one, its descriptorCount is the upper bound and the set is
+// allocated with variable_count. With UPDATE_AFTER_BIND anywhere the set can be written while it is bound,
+// which rules out dynamic buffers in the same set.
+DescriptorSet
+descriptor_set_create_indexed(VkDescriptorSetLayoutBinding *bindings, VkDescriptorBindingFlags *binding_flags, U32 binding_count,
+                              U32 variable_count, Device *ldevice)
 {
   DescriptorSet desc_set = {0};
 
+  B32 update_after_bind = 0;
+  B32 variable          = 0;
+  for (U32 i = 0; binding_flags && i < binding_count; i++) {
+    update_after_bind |= (binding_flags[i] & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) != 0;
+    variable |= (binding_flags[i] & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT) != 0;
+  }
+
+  VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO};
+  flags_info.bindingCount                                = binding_count;
+  flags_info.pBindingFlags                               = binding_flags;
+
   VkDescriptorSetLayoutCreateInfo layout_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
   layout_info.bindingCount                    = binding_count;
   layout_info.pBindings                       = bindings;
+  layout_info.pNext                           = binding_flags ? &flags_info : 0;
+  layout_info.flags                           = update_after_bind ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT : 0;
 
   VK_CHECK(vkCreateDescriptorSetLayout(ldevice->handle, &layout_info, g_allocator, &desc_set.layout));
 
   // binding_count is an upper bound on the number of descriptor sets that can be allocated from the pool
-  VkDescriptorPoolSize *pool_sizes      = malloc(binding_count * sizeof(VkDescriptorPoolSize));
+  Temp                  scratch         = scratch_begin(0, 0);
+  VkDescriptorPoolSize *pool_sizes      = push_array_no_zero(scratch.arena, VkDescriptorPoolSize, binding_count);
   U32                   pool_size_count = 0;
 
   for (U32 i = 0; i < binding_count; i++) {
     VkDescriptorSetLayoutBinding binding = bindings[i];
+
+    // the pool only has to hold what is allocated, not the upper bound
+    if (variable && i == binding_count - 1) {
+      binding.descriptorCount = variable_count;
+    }
+
     if (binding.descriptorCount == 0) {
       continue;
     }
@@ -45,17 +78,24 @@ descriptor_set_create(VkDescriptorSetLayoutBinding *bindings, U32 binding_count,
   desc_pool_info.maxSets                    = 1;
   desc_pool_info.poolSizeCount              = pool_size_count;
   desc_pool_info.pPoolSizes                 = pool_sizes;
+  desc_pool_info.flags                      = update_after_bind ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0;
 
   VK_CHECK(vkCreateDescriptorPool(ldevice->handle, &desc_pool_info, g_allocator, &desc_set.pool));
 
+  VkDescriptorSetVariableDescriptorCountAllocateInfo variable_info = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO};
+  variable_info.descriptorSetCount = 1;
+  variable_info.pDescriptorCounts  = &variable_count;
+
   VkDescriptorSetAllocateInfo allocate_info = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
   allocate_info.descriptorPool              = desc_set.pool;
   allocate_info.descriptorSetCount          = 1;
   allocate_info.pSetLayouts                 = &desc_set.layout;
+  allocate_info.pNext                       = variable ? &variable_info : 0;
 
   VK_CHECK(vkAllocateDescriptorSets(ldevice->handle, &allocate_info, &desc_set.handle));
 
-  free(pool_sizes);
+  scratch_end(scratch);
 
   return desc_set;
 }
@@ -4,7 +4,7 @@
 static VkAllocationCallbacks *g_allocator = 0;
 
 VkFramebuffer
-frame_buffer_create(Swapchain *sc, VkRenderPass render_pass, VkImageView color_view, VkImageView depth_view)
+frame_buffer_create(Device *ldevice, VkRenderPass render_pass, VkImageView color_view, VkImageView depth_view, U32 width, U32 height)
 {
   VkImageView attachments[2] = {color_view, depth_view};
 
@@ -12,12 +12,12 @@ frame_buffer_create(Swapchain *sc, VkRenderPass render_pass, VkImageView color_v
   create_info.renderPass              = render_pass;
   create_info.attachmentCount         = 2;
   create_info.pAttachments            = attachments;
-  create_info.width                   = sc->width;
-  create_info.height                  = sc->height;
+  create_info.width                   = width;
+  create_info.height                  = height;
   create_info.layers                  = 1;
 
   VkFramebuffer framebuffer = {0};
-  vkCreateFramebuffer(sc->ldevice->handle, &create_info, g_allocator, &framebuffer);
+  vkCreateFramebuffer(ldevice->handle, &create_info, g_allocator, &framebuffer);
 
   return framebuffer;
 }
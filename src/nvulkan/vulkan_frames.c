@@ -0,0 +1,135 @@
+#include "nvulkan.h"
+
+#include <string.h>
+
+// Keep this here so we know later where we have to use it
+static VkAllocationCallbacks *g_allocator = 0;
+
+Frames
+frames_create(VkPhysicalDevice pdevice, Device *ldevice, U32 count)
+{
+  Frames frames = {0};
+  frames.count  = Clamp(1, count, FRAMES_IN_FLIGHT_MAX);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(pdevice, &properties);
+
+  // slices start at multiples of FRAME_UNIFORM_SIZE which is a multiple of every allowed offset alignment
+  frames.uniforms = buffer_create_host(frames.count * FRAME_UNIFORM_SIZE, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, pdevice, ldevice);
+
+  for (U32 i = 0; i < frames.count; ++i) {
+    Frame *frame = &frames.frames[i];
+
+    frame->cmd_pool = command_pool_create(ldevice, ldevice->graphics_queue_index);
+    frame->cmd_buf  = command_buffer_allocate(ldevice, frame->cmd_pool);
+    frame->arena    = arena_alloc(FRAME_ARENA_RESERVE_SIZE);
+    frame->staging  = buffer_create_staging(FRAME_STAGING_SIZE, 0, pdevice, ldevice);
+
+    frame->uniform_base      = i * FRAME_UNIFORM_SIZE;
+    frame->uniform_data      = (U8 *)buffer_map(&frames.uniforms) + frame->uniform_base;
+    frame->uniform_alignment = properties.limits.minUniformBufferOffsetAlignment;
+
+    // signaled, so waiting on a frame that was never submitted returns right away
+    VkFenceCreateInfo fence_info = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    fence_info.flags             = VK_FENCE_CREATE_SIGNALED_BIT;
+    VK_CHECK(vkCreateFence(ldevice->handle, &fence_info, g_allocator, &frame->fence));
+
+    VkSemaphoreCreateInfo semaphore_info = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    VK_CHECK(vkCreateSemaphore(ldevice->handle, &semaphore_info, g_allocator, &frame->image_available));
+  }
+
+  return frames;
+}
+
+void
+frames_destroy(Frames *frames, Device *ldevice)
+{
+  for (U32 i = 0; i < frames->count; ++i) {
+    Frame *frame = &frames->frames[i];
+
+    vkDestroySemaphore(ldevice->handle, frame->image_available, g_allocator);
+    vkDestroyFence(ldevice->handle, frame->fence, g_allocator);
+    command_buffer_free(frame->cmd_buf, ldevice, frame->cmd_pool);
+    command_pool_destroy(frame->cmd_pool, ldevice);
+    buffer_destroy(&frame->staging, ldevice);
+    arena_release(frame->arena);
+  }
+
+  buffer_destroy(&frames->uniforms, ldevice);
+
+  MemoryZero(frames, sizeof(Frames));
+}
+
+Frame *
+frames_begin(Frames *frames, Device *ldevice)
+{
+  Frame *frame = &frames->frames[frames->index];
+
+  // only blocks if the gpu is more than count frames behind
+  VK_CHECK(vkWaitForFences(ldevice->handle, 1, &frame->fence, VK_TRUE, UINT64_MAX));
+
+  VK_CHECK(vkResetCommandPool(ldevice->handle, frame->cmd_pool, 0));
+  arena_clear(frame->arena);
+  frame->staging_head = 0;
+  frame->uniform_head = 0;
+
+  command_buffer_begin(frame->cmd_buf);
+
+  return frame;
+}
+
+// submit without a swapchain, for offscreen rendering
+void
+frames_submit(Frame *frame, Device *ldevice)
+{
+  command_buffer_end(frame->cmd_buf);
+
+  VK_CHECK(vkResetFences(ldevice->handle, 1, &frame->fence));
+
+  VkSubmitInfo submit_info       = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers    = &frame->cmd_buf;
+
+  VK_CHECK(vkQueueSubmit(ldevice->graphics_queue, 1, &submit_info, frame->fence));
+}
+
+void
+frames_end(Frames *frames)
+{
+  frames->index = (frames->index + 1) % frames->count;
+  frames->number++;
+}
+
+// Sub allocates the frame's staging buffer, the memory stays valid until the slot is begun again.
+// offset is where the data lives in frame->staging, for use as copy source.
+void *
+frame_stage(Frame *frame, VkDeviceSize size, VkDeviceSize *offset)
+{
+  VkDeviceSize at = AlignPow2(frame->staging_head, 16);
+  if (at + size > FRAME_STAGING_SIZE) {
+    log_fatal("Frame staging buffer exhausted: %llu of %llu bytes", (unsigned long long)(at + size),
+              (unsigned long long)FRAME_STAGING_SIZE);
+  }
+
+  frame->staging_head = at + size;
+  *offset             = at;
+
+  return (U8 *)buffer_map(&frame->staging) + at;
+}
+
+// Writes into the frame's uniform slice, no copy or barrier needed since the gpu reads host memory directly.
+// Returns the dynamic offset to bind the data with, relative to Frames.uniforms.
+U32
+frame_push_uniforms(Frame *frame, void *data, VkDeviceSize size)
+{
+  VkDeviceSize at = AlignPow2(frame->uniform_head, frame->uniform_alignment);
+  if (at + size > FRAME_UNIFORM_SIZE) {
+    log_fatal("Frame uniform buffer exhausted: %llu of %llu bytes", (unsigned long long)(at + size),
+              (unsigned long long)FRAME_UNIFORM_SIZE);
+  }
+
+  MemoryCopy(frame->uniform_data + at, data, size);
+  frame->uniform_head = at + size;
+
+  return (U32)(frame->uniform_base + at);
+}
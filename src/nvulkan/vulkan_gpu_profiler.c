@@ -0,0 +1,219 @@
+#include "nvulkan.h"
+
+#include "base/base_arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Keep this here so we know later where we have to use it
+static VkAllocationCallbacks *g_allocator = 0;
+
+GpuProfiler
+gpu_profiler_create(VkPhysicalDevice pdevice, Device *ldevice, U32 slot_count)
+{
+  GpuProfiler p = {0};
+  p.slot_count  = Min(slot_count, FRAMES_IN_FLIGHT_MAX);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(pdevice, &properties);
+
+  // timestamps are only meaningful if the graphics queue has valid bits
+  Temp scratch = scratch_begin(0, 0);
+
+  U32 queue_family_count;
+  vkGetPhysicalDeviceQueueFamilyProperties(pdevice, &queue_family_count, 0);
+
+  VkQueueFamilyProperties *queue_families = push_array_no_zero(scratch.arena, VkQueueFamilyProperties, queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(pdevice, &queue_family_count, queue_families);
+
+  U32 valid_bits = queue_families[ldevice->graphics_queue_index].timestampValidBits;
+
+  scratch_end(scratch);
+
+  if (valid_bits == 0) {
+    log_dev("Timestamp queries are not supported, gpu profiler disabled");
+    return p;
+  }
+
+  p.supported        = 1;
+  p.timestamp_period = properties.limits.timestampPeriod;
+  p.timestamp_mask   = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+  VkQueryPoolCreateInfo create_info = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  create_info.queryType             = VK_QUERY_TYPE_TIMESTAMP;
+  create_info.queryCount            = p.slot_count * GPU_PROFILER_MARKER_MAX * 2;
+
+  VK_CHECK(vkCreateQueryPool(ldevice->handle, &create_info, g_allocator, &p.query_pool));
+
+  return p;
+}
+
+void
+gpu_profiler_destroy(GpuProfiler *p, Device *ldevice)
+{
+  if (p->query_pool) {
+    vkDestroyQueryPool(ldevice->handle, p->query_pool, g_allocator);
+  }
+
+  MemoryZero(p, sizeof(GpuProfiler));
+}
+
+static void
+gpu_profiler_pass_push(GpuProfilerPass *pass, F32 ms)
+{
+  pass->history[pass->history_head] = ms;
+  pass->history_head                = (pass->history_head + 1) % GPU_PROFILER_HISTORY_MAX;
+  pass->history_count               = Min(pass->history_count + 1, GPU_PROFILER_HISTORY_MAX);
+}
+
+static F32
+gpu_profiler_ticks_to_ms(GpuProfiler *p, U64 begin, U64 end)
+{
+  return (F32)((F64)((end - begin) & p->timestamp_mask) * p->timestamp_period / 1000000.0);
+}
+
+static void
+gpu_profiler_resolve(GpuProfiler *p, Device *ldevice, U32 slot)
+{
+  GpuProfilerSlot *s = &p->slots[slot];
+
+  U64 timestamps[GPU_PROFILER_MARKER_MAX * 2];
+  VK_CHECK(vkGetQueryPoolResults(ldevice->handle, p->query_pool, slot * GPU_PROFILER_MARKER_MAX * 2, s->marker_count * 2,
+                                 s->marker_count * 2 * sizeof(U64), timestamps, sizeof(U64), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+  // a pass that is marked several times in a frame counts once with the sum
+  F32 pass_times[GPU_PROFILER_PASS_MAX] = {0};
+  B32 pass_used[GPU_PROFILER_PASS_MAX]  = {0};
+  F32 frame_time                        = 0.0f;
+
+  for (U32 i = 0; i < s->marker_count; ++i) {
+    U32 pass = s->marker_passes[i];
+
+    pass_times[pass] += gpu_profiler_ticks_to_ms(p, timestamps[i * 2], timestamps[i * 2 + 1]);
+    pass_used[pass] = 1;
+
+    frame_time = Max(frame_time, gpu_profiler_ticks_to_ms(p, timestamps[0], timestamps[i * 2 + 1]));
+  }
+
+  for (U32 pass = 0; pass < p->pass_count; ++pass) {
+    if (pass_used[pass]) {
+      gpu_profiler_pass_push(&p->passes[pass], pass_times[pass]);
+    }
+  }
+
+  if (p->frame_times && s->frame < p->frame_time_count) {
+    p->frame_times[s->frame] = frame_time;
+  }
+
+  s->pending = 0;
+}
+
+// the slot's fence must have signaled, this reads the results of the frame that used the slot before
+void
+gpu_profiler_begin_frame(GpuProfiler *p, Device *ldevice, VkCommandBuffer cmd_buf, U32 slot, U64 frame)
+{
+  if (!p->supported) {
+    return;
+  }
+
+  GpuProfilerSlot *s = &p->slots[slot];
+  if (s->pending) {
+    gpu_profiler_resolve(p, ldevice, slot);
+  }
+
+  p->slot         = slot;
+  s->frame        = frame;
+  s->marker_count = 0;
+
+  vkCmdResetQueryPool(cmd_buf, p->query_pool, slot * GPU_PROFILER_MARKER_MAX * 2, GPU_PROFILER_MARKER_MAX * 2);
+}
+
+// every begin needs its end in the same frame, otherwise resolving waits forever
+U32
+gpu_profiler_begin(GpuProfiler *p, VkCommandBuffer cmd_buf, const char *name)
+{
+  if (!p->supported) {
+    return ~0u;
+  }
+
+  GpuProfilerSlot *s = &p->slots[p->slot];
+  if (s->marker_count == GPU_PROFILER_MARKER_MAX) {
+    return ~0u;
+  }
+
+  U32 pass = 0;
+  while (pass < p->pass_count && strcmp(p->passes[pass].name, name) != 0) {
+    pass++;
+  }
+
+  if (pass == p->pass_count) {
+    if (p->pass_count == GPU_PROFILER_PASS_MAX) {
+      return ~0u;
+    }
+
+    p->passes[p->pass_count++].name = name;
+  }
+
+  U32 marker               = s->marker_count++;
+  s->marker_passes[marker] = pass;
+  s->pending               = 1;
+
+  vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, p->query_pool, (p->slot * GPU_PROFILER_MARKER_MAX + marker) * 2);
+
+  return marker;
+}
+
+void
+gpu_profiler_end(GpuProfiler *p, VkCommandBuffer cmd_buf, U32 marker)
+{
+  if (marker == ~0u) {
+    return;
+  }
+
+  vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, p->query_pool, (p->slot * GPU_PROFILER_MARKER_MAX + marker) * 2 + 1);
+}
+
+// reads every outstanding slot, the device has to be idle
+void
+gpu_profiler_collect(GpuProfiler *p, Device *ldevice)
+{
+  for (U32 slot = 0; slot < p->slot_count; ++slot) {
+    if (p->slots[slot].pending) {
+      gpu_profiler_resolve(p, ldevice, slot);
+    }
+  }
+}
+
+static int
+gpu_profiler_compare(const void *a, const void *b)
+{
+  F32 x = *(const F32 *)a;
+  F32 y = *(const F32 *)b;
+  return (x > y) - (x < y);
+}
+
+void
+gpu_profiler_pass_stats(GpuProfiler *p, U32 pass, GpuProfilerStats *stats)
+{
+  MemoryZero(stats, sizeof(GpuProfilerStats));
+
+  GpuProfilerPass *pp = &p->passes[pass];
+  if (pp->history_count == 0) {
+    return;
+  }
+
+  F32 sorted[GPU_PROFILER_HISTORY_MAX];
+  MemoryCopy(sorted, pp->history, pp->history_count * sizeof(F32));
+  qsort(sorted, pp->history_count, sizeof(F32), gpu_profiler_compare);
+
+  F32 sum = 0.0f;
+  for (U32 i = 0; i < pp->history_count; ++i) {
+    sum += sorted[i];
+  }
+
+  stats->count = pp->history_count;
+  stats->min   = sorted[0];
+  stats->avg   = sum / pp->history_count;
+  stats->p99   = sorted[(pp->history_count - 1) * 99 / 100];
+  stats->last  = pp->history[(pp->history_head + GPU_PROFILER_HISTORY_MAX - 1) % GPU_PROFILER_HISTORY_MAX];
+}
@@ -16,8 +16,9 @@ image_create(U32 width, U32 height, VkFormat format, U32 mip_levels, VkImageAspe
              VkPhysicalDevice pdevice, Device *ldevice)
 {
   // Create image handle
-  Image image  = {0};
-  image.format = format;
+  Image image      = {0};
+  image.format     = format;
+  image.mip_levels = mip_levels;
 
   VkImageCreateInfo image_info = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
   image_info.imageType         = VK_IMAGE_TYPE_2D;
@@ -40,12 +41,9 @@ image_create(U32 width, U32 height, VkFormat format, U32 mip_levels, VkImageAspe
   VkMemoryRequirements mem_reqs;
   vkGetImageMemoryRequirements(ldevice->handle, image.handle, &mem_reqs);
 
-  VkMemoryAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-  alloc_info.allocationSize       = mem_reqs.size;
-  alloc_info.memoryTypeIndex      = memory_type_find(pdevice, mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  image.allocation = memory_alloc(&ldevice->allocator, &mem_reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
 
-  VK_CHECK(vkAllocateMemory(ldevice->handle, &alloc_info, g_allocator, &image.memory));
-  VK_CHECK(vkBindImageMemory(ldevice->handle, image.handle, image.memory, 0));
+  VK_CHECK(vkBindImageMemory(ldevice->handle, image.handle, image.allocation.memory, image.allocation.offset));
 
   // Create image view
 
@@ -69,7 +67,7 @@ image_destroy(Image *image, Device *ldevice)
 {
   vkDestroyImageView(ldevice->handle, image->view, g_allocator);
   vkDestroyImage(ldevice->handle, image->handle, g_allocator);
-  vkFreeMemory(ldevice->handle, image->memory, g_allocator);
+  memory_free(&ldevice->allocator, &image->allocation);
 }
 
 Texture
@@ -91,45 +89,50 @@ texture_create(U32 width, U32 height, VkFormat format, VkImageAspectFlags aspect
 
 Texture
 texture_from_pixels(U32 width, U32 height, U32 channels, VkFormat format, U8 *pixels, VkSamplerCreateInfo sampler_info,
-                    VkPhysicalDevice pdevice, Device *ldevice, VkCommandPool cmd_pool)
+                    VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader)
 {
   Texture t = {0};
 
-  Image image = image_create(width, height, format, get_mip_levels(width, height), VK_IMAGE_ASPECT_COLOR_BIT,
-                             VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, pdevice, ldevice);
+  // the mip chain is blitted down from level 0 with a linear filter, formats that can't do that only get level 0
+  VkFormatProperties format_properties;
+  vkGetPhysicalDeviceFormatProperties(pdevice, format, &format_properties);
 
-  // Copy pixels to image
-  VkDeviceSize size           = width * height * channels;
-  Buffer       staging_buffer = buffer_create_staging(size, pixels, pdevice, ldevice);
+  VkFormatFeatureFlags blit_features =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-  VkCommandBuffer cmd_buf = command_buffer_allocate(ldevice, cmd_pool);
-  command_buffer_begin(cmd_buf);
+  U32 mip_levels = 1;
+  if ((format_properties.optimalTilingFeatures & blit_features) == blit_features) {
+    mip_levels = get_mip_levels(width, height);
+  }
 
-  image_transition_layout(&image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, cmd_buf);
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  Image             image = image_create(width, height, format, mip_levels, VK_IMAGE_ASPECT_COLOR_BIT, usage, pdevice, ldevice);
 
-  VkBufferImageCopy region           = {0};
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.layerCount = 1;
-  region.imageExtent.width           = width;
-  region.imageExtent.height          = height;
-  region.imageExtent.depth           = 1;
-  region.bufferOffset                = 0;
-  region.bufferRowLength             = 0;
-  region.bufferImageHeight           = 0;
-  region.imageExtent.width           = width;
-  region.imageExtent.height          = height;
-  region.imageExtent.depth           = 1;
-  region.imageOffset                 = (VkOffset3D){0, 0, 0};
+  // the pixels are copied into the staging ring right away, so the caller can free them
+  VkDeviceSize size = (VkDeviceSize)width * height * channels;
+  uploader_upload_image(uploader, &image, width, height, pixels, size);
 
-  vkCmdCopyBufferToImage(cmd_buf, staging_buffer.handle, image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  t.image                  = image;
+  t.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  t.descriptor.imageView   = image.view;
 
-  image_transition_layout(&image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT,
-                          cmd_buf);
+  vkCreateSampler(ldevice->handle, &sampler_info, g_allocator, &t.descriptor.sampler);
 
-  command_buffer_submit(cmd_buf, ldevice);
-  command_buffer_free(cmd_buf, ldevice, cmd_pool);
+  return t;
+}
+
+// Uploads precomputed mips as they are, e.g. block compressed or KTX2 data. See uploader_upload_image_levels for the layout.
+// The device needs texture_compression_bc for BC formats.
+Texture
+texture_from_levels(U32 width, U32 height, U32 mip_levels, VkFormat format, U8 *data, VkDeviceSize size, VkDeviceSize *level_offsets,
+                    VkSamplerCreateInfo sampler_info, VkPhysicalDevice pdevice, Device *ldevice, Uploader *uploader)
+{
+  Texture t = {0};
+
+  Image image = image_create(width, height, format, mip_levels, VK_IMAGE_ASPECT_COLOR_BIT,
+                             VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, pdevice, ldevice);
 
-  buffer_destroy(&staging_buffer, ldevice);
+  uploader_upload_image_levels(uploader, &image, width, height, data, size, level_offsets);
 
   t.image                  = image;
   t.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -167,12 +170,66 @@ image_transition_layout(Image *image, VkImageLayout old_layout, VkImageLayout ne
   vkCmdPipelineBarrier(cmd_buf, src_stage, dst_stage, 0, 0, 0, 0, 0, 1, &barrier);
 }
 
+// copies mip 0 of a color image that was last written as a color attachment, the buffer is readable on the host
+// once the command buffer's fence signaled
+void
+image_copy_to_buffer(VkCommandBuffer cmd_buf, Image *image, VkImageLayout layout, U32 width, U32 height, Buffer *dst)
+{
+  VkImageMemoryBarrier image_barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  image_barrier.oldLayout            = layout;
+  image_barrier.newLayout            = layout;
+  image_barrier.image                = image->handle;
+  image_barrier.subresourceRange     = (VkImageSubresourceRange){VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  image_barrier.srcAccessMask        = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  image_barrier.dstAccessMask        = VK_ACCESS_TRANSFER_READ_BIT;
+  image_barrier.srcQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+  image_barrier.dstQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1,
+                       &image_barrier);
+
+  VkBufferImageCopy region = {0};
+  region.imageSubresource  = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent       = (VkExtent3D){width, height, 1};
+
+  vkCmdCopyImageToBuffer(cmd_buf, image->handle, layout, dst->handle, 1, &region);
+
+  VkBufferMemoryBarrier buffer_barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+  buffer_barrier.srcAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
+  buffer_barrier.dstAccessMask         = VK_ACCESS_HOST_READ_BIT;
+  buffer_barrier.srcQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+  buffer_barrier.dstQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+  buffer_barrier.buffer                = dst->handle;
+  buffer_barrier.size                  = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, 0, 1, &buffer_barrier, 0, 0);
+}
+
+// depth + stencil, D24S8 is not available everywhere (e.g. amd and some software implementations)
+VkFormat
+image_find_depth_format(VkPhysicalDevice pdevice)
+{
+  VkFormat candidates[] = {VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D16_UNORM_S8_UINT};
+
+  for (U32 i = 0; i < ArrayCount(candidates); ++i) {
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(pdevice, candidates[i], &props);
+
+    if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+      return candidates[i];
+    }
+  }
+
+  log_fatal("No supported depth stencil format!");
+  return VK_FORMAT_UNDEFINED;
+}
+
 Image
 image_create_depth(VkPhysicalDevice pdevice, Device *ldevice, Swapchain *sc, VkCommandPool cmd_pool)
 {
   // Create depth buffer
   VkImageAspectFlags depth_aspect = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-  Image              depth_image  = image_create(sc->width, sc->height, VK_FORMAT_D24_UNORM_S8_UINT, 1, depth_aspect,
+  Image              depth_image  = image_create(sc->width, sc->height, image_find_depth_format(pdevice), 1, depth_aspect,
                                                  VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, pdevice, ldevice);
   VkCommandBuffer    cmd_buf      = command_buffer_allocate(ldevice, cmd_pool);
   command_buffer_begin(cmd_buf);
@@ -1,5 +1,9 @@
 #include "nvulkan.h"
 
+#include "base/base_arena.h"
+
+#include <string.h>
+
 // Keep this here so we know later where we have to use it
 static VkAllocationCallbacks *g_allocator = 0;
 
@@ -11,18 +15,44 @@ vulkan_instance_create(const char *name, int version, const char **extensions, U
   application_info.pEngineName       = name;
   application_info.apiVersion        = version;
 
-  // @Todo: check if extensions and layers are available
+  // @Todo: check if extensions are available
+
+  // layers are optional, build machines usually don't have the validation layers installed
+  Temp scratch = scratch_begin(0, 0);
+
+  U32 available_count;
+  VK_CHECK(vkEnumerateInstanceLayerProperties(&available_count, 0));
+
+  VkLayerProperties *available = push_array_no_zero(scratch.arena, VkLayerProperties, available_count);
+  VK_CHECK(vkEnumerateInstanceLayerProperties(&available_count, available));
+
+  const char **enabled_layers      = push_array(scratch.arena, const char *, layer_count);
+  U32          enabled_layer_count = 0;
+  for (U32 i = 0; i < layer_count; ++i) {
+    B32 found = 0;
+    for (U32 j = 0; j < available_count && !found; ++j) {
+      found = strcmp(available[j].layerName, layers[i]) == 0;
+    }
+
+    if (found) {
+      enabled_layers[enabled_layer_count++] = layers[i];
+    } else {
+      log_dev("Layer %s is not available", layers[i]);
+    }
+  }
 
   VkInstanceCreateInfo create_info    = {VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
   create_info.pApplicationInfo        = &application_info;
   create_info.enabledExtensionCount   = extension_count;
   create_info.ppEnabledExtensionNames = extensions;
-  create_info.enabledLayerCount       = layer_count;
-  create_info.ppEnabledLayerNames     = layers;
+  create_info.enabledLayerCount       = enabled_layer_count;
+  create_info.ppEnabledLayerNames     = enabled_layers;
 
   VkInstance instance;
   VK_CHECK(vkCreateInstance(&create_info, g_allocator, &instance));
 
+  scratch_end(scratch);
+
   return instance;
 }
 
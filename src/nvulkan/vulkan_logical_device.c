@@ -1,5 +1,7 @@
 #include "nvulkan.h"
 
+#include "base/base_arena.h"
+
 // Keep this here so we know later where we have to use it
 static VkAllocationCallbacks *g_allocator = 0;
 
@@ -10,50 +12,133 @@ logical_device_create(VkSurfaceKHR surface, VkPhysicalDevice pdevice, const char
   VkPhysicalDeviceMemoryProperties memory_properties;
   vkGetPhysicalDeviceMemoryProperties(pdevice, &memory_properties);
 
+  Temp scratch = scratch_begin(0, 0);
+
   U32 queue_family_count;
   vkGetPhysicalDeviceQueueFamilyProperties(pdevice, &queue_family_count, 0);
 
-  VkQueueFamilyProperties *queue_families = malloc(queue_family_count * sizeof(VkQueueFamilyProperties));
+  VkQueueFamilyProperties *queue_families = push_array_no_zero(scratch.arena, VkQueueFamilyProperties, queue_family_count);
   vkGetPhysicalDeviceQueueFamilyProperties(pdevice, &queue_family_count, queue_families);
 
-  // Setup device queues
-  VkDeviceQueueCreateInfo queue_create_infos[1];
-
-  F32 queue_priority = 1.0f;
-
+  // Graphics (with present), transfer and async compute queues. Transfer prefers a family that can only transfer, these are
+  // the dma engines of discrete gpus, compute prefers a family without graphics. Both fall back to the graphics family.
   U32 graphics_index = ~0u;
+  U32 transfer_index = ~0u;
+  U32 compute_index  = ~0u;
   for (U32 i = 0; i < queue_family_count; ++i) {
-    VkQueueFamilyProperties queue_family = queue_families[i];
+    VkQueueFlags flags = queue_families[i].queueFlags;
 
-    if ((queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
-      B32 present_supported = VK_FALSE;
-      vkGetPhysicalDeviceSurfaceSupportKHR(pdevice, i, surface, &present_supported);
+    if ((flags & VK_QUEUE_GRAPHICS_BIT) && graphics_index == ~0u) {
+      // without a surface (headless) there is nothing to present to
+      B32 present_supported = VK_TRUE;
+      if (surface) {
+        vkGetPhysicalDeviceSurfaceSupportKHR(pdevice, i, surface, &present_supported);
+      }
 
-      if (!present_supported) {
-        continue;
+      if (present_supported) {
+        graphics_index = i;
       }
+    }
+
+    if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && transfer_index == ~0u) {
+      transfer_index = i;
+    }
+
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && compute_index == ~0u) {
+      compute_index = i;
+    }
+  }
+
+  if (graphics_index == ~0u) {
+    log_fatal("No queue family with graphics and present support!");
+  }
+
+  // compute families can always transfer
+  if (transfer_index == ~0u) {
+    transfer_index = compute_index != ~0u ? compute_index : graphics_index;
+  }
+  if (compute_index == ~0u) {
+    compute_index = graphics_index;
+  }
 
-      VkDeviceQueueCreateInfo create_info = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
-      create_info.queueFamilyIndex        = i;
-      create_info.queueCount              = 1; // @Todo: check: Maybe we want more?
-      create_info.pQueuePriorities        = &queue_priority;
+  // Setup device queues, one per distinct family
+  VkDeviceQueueCreateInfo queue_create_infos[3];
+  U32                     queue_create_info_count = 0;
+
+  F32 queue_priority = 1.0f;
 
-      queue_create_infos[0] = create_info;
+  U32 family_indices[] = {graphics_index, transfer_index, compute_index};
+  for (U32 i = 0; i < ArrayCount(family_indices); ++i) {
+    B32 duplicate = 0;
+    for (U32 j = 0; j < i; ++j) {
+      duplicate |= family_indices[i] == family_indices[j];
+    }
 
-      graphics_index = i;
-      break;
+    if (duplicate) {
+      continue;
     }
+
+    VkDeviceQueueCreateInfo create_info = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+    create_info.queueFamilyIndex        = family_indices[i];
+    create_info.queueCount              = 1;
+    create_info.pQueuePriorities        = &queue_priority;
+
+    queue_create_infos[queue_create_info_count++] = create_info;
   }
-  VkPhysicalDeviceVulkan12Features features_vulkan12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
-  features_vulkan12.bufferDeviceAddress              = VK_TRUE;
-  features_vulkan12.runtimeDescriptorArray           = VK_TRUE;
 
-  VkPhysicalDeviceFeatures features_core = {0};
-  features_core.shaderInt64              = VK_TRUE;
-  features_core.geometryShader           = VK_TRUE;
+  VkPhysicalDeviceVulkan12Features supported_vulkan12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  VkPhysicalDeviceFeatures2        supported_all      = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+  supported_all.pNext                                 = &supported_vulkan12;
+  vkGetPhysicalDeviceFeatures2(pdevice, &supported_all);
+
+  VkPhysicalDeviceFeatures supported_features = supported_all.features;
+
+  // The renderer has no path without these, so a device that lacks one is rejected here with its name instead of
+  // failing in vkCreateDevice. Bindless textures are one partially bound array of variable size, written after
+  // binding and indexed per material.
+  struct {
+    VkBool32    supported;
+    const char *name;
+  } required[] = {
+      {supported_features.shaderInt64, "shaderInt64"},
+      {supported_features.geometryShader, "geometryShader"},
+      {supported_vulkan12.bufferDeviceAddress, "bufferDeviceAddress"},
+      {supported_vulkan12.runtimeDescriptorArray, "runtimeDescriptorArray"},
+      {supported_vulkan12.descriptorIndexing, "descriptorIndexing"},
+      {supported_vulkan12.shaderSampledImageArrayNonUniformIndexing, "shaderSampledImageArrayNonUniformIndexing"},
+      {supported_vulkan12.descriptorBindingPartiallyBound, "descriptorBindingPartiallyBound"},
+      {supported_vulkan12.descriptorBindingVariableDescriptorCount, "descriptorBindingVariableDescriptorCount"},
+      {supported_vulkan12.descriptorBindingSampledImageUpdateAfterBind, "descriptorBindingSampledImageUpdateAfterBind"},
+  };
+
+  for (U32 i = 0; i < ArrayCount(required); ++i) {
+    if (!required[i].supported) {
+      log_fatal("The GPU does not support the Vulkan feature %s which is required!", required[i].name);
+    }
+  }
+
+  VkPhysicalDeviceVulkan12Features features_vulkan12             = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  features_vulkan12.bufferDeviceAddress                          = VK_TRUE;
+  features_vulkan12.runtimeDescriptorArray                       = VK_TRUE;
+  features_vulkan12.descriptorIndexing                           = VK_TRUE;
+  features_vulkan12.shaderSampledImageArrayNonUniformIndexing    = VK_TRUE;
+  features_vulkan12.descriptorBindingPartiallyBound              = VK_TRUE;
+  features_vulkan12.descriptorBindingVariableDescriptorCount     = VK_TRUE;
+  features_vulkan12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+
+  // the scene is drawn with one indirect call, without these every model is drawn on its own
+  B32 multi_draw_indirect = supported_features.multiDrawIndirect && supported_features.drawIndirectFirstInstance;
+
+  // block compressed textures are optional, without them textures are uploaded uncompressed
+  VkPhysicalDeviceFeatures features_core  = {0};
+  features_core.shaderInt64               = VK_TRUE;
+  features_core.geometryShader            = VK_TRUE;
+  features_core.textureCompressionBC      = supported_features.textureCompressionBC;
+  features_core.multiDrawIndirect         = multi_draw_indirect;
+  features_core.drawIndirectFirstInstance = multi_draw_indirect;
 
   VkDeviceCreateInfo create_info      = {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
-  create_info.queueCreateInfoCount    = ArrayCount(queue_create_infos);
+  create_info.queueCreateInfoCount    = queue_create_info_count;
   create_info.pQueueCreateInfos       = queue_create_infos;
   create_info.enabledExtensionCount   = extension_count;
   create_info.ppEnabledExtensionNames = extensions;
@@ -65,20 +150,30 @@ logical_device_create(VkSurfaceKHR surface, VkPhysicalDevice pdevice, const char
   VkDevice handle;
   VK_CHECK(vkCreateDevice(pdevice, &create_info, g_allocator, &handle));
 
-  VkQueue graphics_queue;
-  vkGetDeviceQueue(handle, graphics_index, 0, &graphics_queue);
-
-  Device ldevice;
+  Device ldevice               = {0};
   ldevice.handle               = handle;
-  ldevice.graphics_queue       = graphics_queue;
   ldevice.graphics_queue_index = graphics_index;
+  ldevice.transfer_queue_index = transfer_index;
+  ldevice.compute_queue_index  = compute_index;
+
+  ldevice.texture_compression_bc = supported_features.textureCompressionBC;
+  ldevice.multi_draw_indirect    = multi_draw_indirect;
+
+  vkGetDeviceQueue(handle, graphics_index, 0, &ldevice.graphics_queue);
+  vkGetDeviceQueue(handle, transfer_index, 0, &ldevice.transfer_queue);
+  vkGetDeviceQueue(handle, compute_index, 0, &ldevice.compute_queue);
+
+  log_dev("Queue families: graphics %u, transfer %u, compute %u", graphics_index, transfer_index, compute_index);
+
+  memory_allocator_init(&ldevice.allocator, pdevice, handle);
 
-  free(queue_families);
+  scratch_end(scratch);
   return ldevice;
 }
 
 void
 logical_device_destroy(Device *ldevice)
 {
+  memory_allocator_release(&ldevice->allocator);
   vkDestroyDevice(ldevice->handle, g_allocator);
 }
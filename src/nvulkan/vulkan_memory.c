@@ -0,0 +1,386 @@
+#include "nvulkan.h"
+
+#include <string.h>
+
+// Keep this here so we know later where we have to use it
+static VkAllocationCallbacks *g_allocator = 0;
+
+static VkDeviceSize
+memory_block_size_for_heap(MemoryAllocator *allocator, U32 memory_type_index)
+{
+  U32          heap_index = allocator->memory_properties.memoryTypes[memory_type_index].heapIndex;
+  VkDeviceSize heap_size  = allocator->memory_properties.memoryHeaps[heap_index].size;
+
+  // small heaps (like the 256mb host visible device heap) would be used up by a few blocks
+  if (heap_size <= MEMORY_SMALL_HEAP_SIZE) {
+    return AlignPow2(heap_size / 8, KB(64));
+  }
+
+  return MEMORY_BLOCK_SIZE;
+}
+
+static U32
+memory_type_find_cached(MemoryAllocator *allocator, U32 type_bits, VkMemoryPropertyFlags flags)
+{
+  for (U32 i = 0; i < allocator->memory_properties.memoryTypeCount; ++i) {
+    if ((type_bits & (1 << i)) && (allocator->memory_properties.memoryTypes[i].propertyFlags & flags) == flags) {
+      return i;
+    }
+  }
+
+  log_fatal("No memory type with properties 0x%x for type bits 0x%x!", flags, type_bits);
+  return 0;
+}
+
+static void
+memory_block_insert_range(MemoryBlock *block, U32 index, MemoryRange range)
+{
+  if (block->free_range_count == block->free_range_capacity) {
+    block->free_range_capacity = block->free_range_capacity ? block->free_range_capacity * 2 : 16;
+    block->free_ranges         = realloc(block->free_ranges, block->free_range_capacity * sizeof(MemoryRange));
+  }
+
+  MemoryCopy(&block->free_ranges[index + 1], &block->free_ranges[index], (block->free_range_count - index) * sizeof(MemoryRange));
+  block->free_ranges[index] = range;
+  block->free_range_count++;
+}
+
+static void
+memory_block_remove_range(MemoryBlock *block, U32 index)
+{
+  MemoryCopy(&block->free_ranges[index], &block->free_ranges[index + 1], (block->free_range_count - index - 1) * sizeof(MemoryRange));
+  block->free_range_count--;
+}
+
+static MemoryBlock *
+memory_block_create(MemoryAllocator *allocator, MemoryPool *pool, VkDeviceSize size, B32 dedicated)
+{
+  VkMemoryAllocateInfo alloc_info = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+  alloc_info.allocationSize       = size;
+  alloc_info.memoryTypeIndex      = pool->memory_type_index;
+
+  // bufferDeviceAddress is enabled on the device, so every buffer block can back an addressable buffer
+  VkMemoryAllocateFlagsInfo alloc_flags = {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
+  alloc_flags.flags                     = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+  if (pool->linear) {
+    alloc_info.pNext = &alloc_flags;
+  }
+
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(allocator->device, &alloc_info, g_allocator, &memory) != VK_SUCCESS) {
+    log_fatal("Failed to allocate %llu bytes of device memory (type %u)!", (unsigned long long)size, pool->memory_type_index);
+  }
+
+  MemoryBlock *block = calloc(1, sizeof(MemoryBlock));
+  block->memory      = memory;
+  block->size        = size;
+  block->dedicated   = dedicated;
+
+  block->memory_type_index = pool->memory_type_index;
+  block->linear            = pool->linear;
+
+  VkMemoryPropertyFlags flags = allocator->memory_properties.memoryTypes[pool->memory_type_index].propertyFlags;
+  if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    void *mapped;
+    VK_CHECK(vkMapMemory(allocator->device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+    block->mapped = (U8 *)mapped;
+  }
+
+  MemoryRange whole = {0, size};
+  memory_block_insert_range(block, 0, whole);
+
+  if (pool->block_count == pool->block_capacity) {
+    pool->block_capacity = pool->block_capacity ? pool->block_capacity * 2 : 4;
+    pool->blocks         = realloc(pool->blocks, pool->block_capacity * sizeof(MemoryBlock *));
+  }
+  pool->blocks[pool->block_count++] = block;
+
+  return block;
+}
+
+static void
+memory_block_destroy(MemoryAllocator *allocator, MemoryBlock *block)
+{
+  // freeing the memory implicitly unmaps it
+  vkFreeMemory(allocator->device, block->memory, g_allocator);
+  free(block->free_ranges);
+  free(block);
+}
+
+// best fit over the free ranges, returns the index of the range or ~0u
+static U32
+memory_block_find(MemoryBlock *block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *out_offset)
+{
+  U32          best_index = ~0u;
+  VkDeviceSize best_waste = ~0ull;
+
+  for (U32 i = 0; i < block->free_range_count; ++i) {
+    MemoryRange  range  = block->free_ranges[i];
+    VkDeviceSize offset = AlignPow2(range.offset, alignment);
+    VkDeviceSize end    = range.offset + range.size;
+
+    if (offset + size > end) {
+      continue;
+    }
+
+    VkDeviceSize waste = range.size - size;
+    if (waste < best_waste) {
+      best_index  = i;
+      best_waste  = waste;
+      *out_offset = offset;
+
+      if (waste == 0) {
+        break;
+      }
+    }
+  }
+
+  return best_index;
+}
+
+static void
+memory_block_take(MemoryBlock *block, U32 index, VkDeviceSize offset, VkDeviceSize size)
+{
+  MemoryRange range = block->free_ranges[index];
+  MemoryRange head  = {range.offset, offset - range.offset};
+  MemoryRange tail  = {offset + size, range.offset + range.size - (offset + size)};
+
+  memory_block_remove_range(block, index);
+
+  // alignment padding in front stays free so it can be reused by smaller allocations
+  if (tail.size > 0) {
+    memory_block_insert_range(block, index, tail);
+  }
+  if (head.size > 0) {
+    memory_block_insert_range(block, index, head);
+  }
+
+  block->used += size;
+  block->allocation_count++;
+}
+
+static void
+memory_block_give_back(MemoryBlock *block, VkDeviceSize offset, VkDeviceSize size)
+{
+  // find the first free range after the freed one
+  U32 lo = 0;
+  U32 hi = block->free_range_count;
+  while (lo < hi) {
+    U32 mid = lo + (hi - lo) / 2;
+    if (block->free_ranges[mid].offset < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  MemoryRange range = {offset, size};
+
+  B32 merge_prev = lo > 0 && block->free_ranges[lo - 1].offset + block->free_ranges[lo - 1].size == offset;
+  B32 merge_next = lo < block->free_range_count && offset + size == block->free_ranges[lo].offset;
+
+  if (merge_prev && merge_next) {
+    block->free_ranges[lo - 1].size += size + block->free_ranges[lo].size;
+    memory_block_remove_range(block, lo);
+  } else if (merge_prev) {
+    block->free_ranges[lo - 1].size += size;
+  } else if (merge_next) {
+    block->free_ranges[lo].offset = offset;
+    block->free_ranges[lo].size += size;
+  } else {
+    memory_block_insert_range(block, lo, range);
+  }
+
+  block->used -= size;
+  block->allocation_count--;
+}
+
+void
+memory_allocator_init(MemoryAllocator *allocator, VkPhysicalDevice pdevice, VkDevice device)
+{
+  MemoryZero(allocator, sizeof(MemoryAllocator));
+
+  allocator->device = device;
+  vkGetPhysicalDeviceMemoryProperties(pdevice, &allocator->memory_properties);
+
+  for (U32 type = 0; type < VK_MAX_MEMORY_TYPES; ++type) {
+    for (U32 kind = 0; kind < MEMORY_POOL_KIND_COUNT; ++kind) {
+      allocator->pools[type][kind].memory_type_index = type;
+      allocator->pools[type][kind].linear            = kind == 0;
+    }
+  }
+}
+
+void
+memory_allocator_release(MemoryAllocator *allocator)
+{
+  for (U32 type = 0; type < VK_MAX_MEMORY_TYPES; ++type) {
+    for (U32 kind = 0; kind < MEMORY_POOL_KIND_COUNT; ++kind) {
+      MemoryPool *pool = &allocator->pools[type][kind];
+
+      for (U32 i = 0; i < pool->block_count; ++i) {
+        if (pool->blocks[i]->allocation_count > 0) {
+          log_dev("Leaked %u device memory allocations (type %u)", pool->blocks[i]->allocation_count, type);
+        }
+
+        memory_block_destroy(allocator, pool->blocks[i]);
+      }
+
+      free(pool->blocks);
+    }
+  }
+
+  MemoryZero(allocator, sizeof(MemoryAllocator));
+}
+
+MemoryAllocation
+memory_alloc(MemoryAllocator *allocator, VkMemoryRequirements *reqs, VkMemoryPropertyFlags properties, B32 linear)
+{
+  U32         type = memory_type_find_cached(allocator, reqs->memoryTypeBits, properties);
+  MemoryPool *pool = &allocator->pools[type][linear ? 0 : 1];
+
+  VkDeviceSize block_size = memory_block_size_for_heap(allocator, type);
+  VkDeviceSize alignment  = Max(reqs->alignment, 1);
+
+  MemoryBlock *block  = 0;
+  U32          index  = ~0u;
+  VkDeviceSize offset = 0;
+
+  if (reqs->size > MEMORY_DEDICATED_THRESHOLD(block_size)) {
+    // big resources get their own block, they would only fragment the shared ones
+    block = memory_block_create(allocator, pool, reqs->size, 1);
+    index = 0;
+  } else {
+    for (U32 i = 0; i < pool->block_count && index == ~0u; ++i) {
+      if (pool->blocks[i]->dedicated) {
+        continue;
+      }
+
+      index = memory_block_find(pool->blocks[i], reqs->size, alignment, &offset);
+      block = pool->blocks[i];
+    }
+
+    if (index == ~0u) {
+      block = memory_block_create(allocator, pool, block_size, 0);
+      index = memory_block_find(block, reqs->size, alignment, &offset);
+    }
+  }
+
+  memory_block_take(block, index, offset, reqs->size);
+
+  MemoryAllocation allocation = {0};
+  allocation.memory           = block->memory;
+  allocation.offset           = offset;
+  allocation.size             = reqs->size;
+  allocation.mapped           = block->mapped ? block->mapped + offset : 0;
+  allocation.block            = block;
+
+  return allocation;
+}
+
+void
+memory_free(MemoryAllocator *allocator, MemoryAllocation *allocation)
+{
+  MemoryBlock *block = allocation->block;
+  if (!block) {
+    return;
+  }
+
+  MemoryPool *pool = &allocator->pools[block->memory_type_index][block->linear ? 0 : 1];
+
+  memory_block_give_back(block, allocation->offset, allocation->size);
+
+  // keep one shared block per pool around so that load/unload cycles don't hit vkAllocateMemory every time
+  U32 shared_count = 0;
+  for (U32 i = 0; i < pool->block_count; ++i) {
+    shared_count += !pool->blocks[i]->dedicated;
+  }
+
+  if (block->allocation_count == 0 && (block->dedicated || shared_count > 1)) {
+    for (U32 i = 0; i < pool->block_count; ++i) {
+      if (pool->blocks[i] == block) {
+        pool->blocks[i] = pool->blocks[--pool->block_count];
+        break;
+      }
+    }
+
+    memory_block_destroy(allocator, block);
+  }
+
+  MemoryZero(allocation, sizeof(MemoryAllocation));
+}
+
+static void
+memory_stats_finish(MemoryStats *stats)
+{
+  U64 free_bytes       = stats->reserved_bytes - stats->used_bytes;
+  stats->fragmentation = free_bytes ? 1.0f - (F32)stats->largest_free_range / (F32)free_bytes : 0.0f;
+}
+
+void
+memory_allocator_stats(MemoryAllocator *allocator, MemoryStats *type_stats, MemoryStats *total)
+{
+  MemoryZero(total, sizeof(MemoryStats));
+
+  for (U32 type = 0; type < allocator->memory_properties.memoryTypeCount; ++type) {
+    MemoryStats *stats = &type_stats[type];
+    MemoryZero(stats, sizeof(MemoryStats));
+
+    for (U32 kind = 0; kind < MEMORY_POOL_KIND_COUNT; ++kind) {
+      MemoryPool *pool = &allocator->pools[type][kind];
+
+      for (U32 i = 0; i < pool->block_count; ++i) {
+        MemoryBlock *block = pool->blocks[i];
+
+        stats->block_count++;
+        stats->dedicated_block_count += block->dedicated;
+        stats->allocation_count += block->allocation_count;
+        stats->reserved_bytes += block->size;
+        stats->used_bytes += block->used;
+        stats->free_range_count += block->free_range_count;
+
+        for (U32 r = 0; r < block->free_range_count; ++r) {
+          stats->largest_free_range = Max(stats->largest_free_range, block->free_ranges[r].size);
+        }
+      }
+    }
+
+    memory_stats_finish(stats);
+
+    total->block_count += stats->block_count;
+    total->dedicated_block_count += stats->dedicated_block_count;
+    total->allocation_count += stats->allocation_count;
+    total->reserved_bytes += stats->reserved_bytes;
+    total->used_bytes += stats->used_bytes;
+    total->free_range_count += stats->free_range_count;
+    total->largest_free_range = Max(total->largest_free_range, stats->largest_free_range);
+  }
+
+  memory_stats_finish(total);
+}
+
+void
+memory_allocator_dump(MemoryAllocator *allocator)
+{
+  MemoryStats type_stats[VK_MAX_MEMORY_TYPES];
+  MemoryStats total;
+  memory_allocator_stats(allocator, type_stats, &total);
+
+  log_dev("Device memory: %llu allocations in %llu blocks, %.2f / %.2f MB used, fragmentation %.2f",
+          (unsigned long long)total.allocation_count, (unsigned long long)total.block_count, (F64)total.used_bytes / MB(1),
+          (F64)total.reserved_bytes / MB(1), total.fragmentation);
+
+  for (U32 type = 0; type < allocator->memory_properties.memoryTypeCount; ++type) {
+    MemoryStats *stats = &type_stats[type];
+    if (stats->block_count == 0) {
+      continue;
+    }
+
+    log_dev("  type %u (heap %u, flags 0x%x): %llu allocations in %llu blocks (%llu dedicated), %.2f / %.2f MB used, %llu free ranges, "
+            "fragmentation %.2f",
+            type, allocator->memory_properties.memoryTypes[type].heapIndex, allocator->memory_properties.memoryTypes[type].propertyFlags,
+            (unsigned long long)stats->allocation_count, (unsigned long long)stats->block_count,
+            (unsigned long long)stats->dedicated_block_count, (F64)stats->used_bytes / MB(1), (F64)stats->reserved_bytes / MB(1),
+            (unsigned long long)stats->free_range_count, stats->fragmentation);
+  }
+}
@@ -1,20 +1,45 @@
 #include "nvulkan.h"
 
+#include "base/base_arena.h"
+
 #include <string.h>
 
 // Keep this here so we know later where we have to use it
 static VkAllocationCallbacks *g_allocator = 0;
 
+// discrete gpus first, software implementations like lavapipe only if nothing else is there
+static U32
+physical_device_type_rank(VkPhysicalDeviceType type)
+{
+  switch (type) {
+  case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+    return 4;
+  case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+    return 3;
+  case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+    return 2;
+  case VK_PHYSICAL_DEVICE_TYPE_CPU:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
 VkPhysicalDevice
 physical_device_find_compatible(VkInstance instance, const char **required_extensions, U32 required_extension_count)
 {
+  Temp scratch = scratch_begin(0, 0);
+
   // Get all physical devices
   U32 device_count;
   VK_CHECK(vkEnumeratePhysicalDevices(instance, &device_count, 0));
 
-  VkPhysicalDevice *devices = malloc(device_count * sizeof(VkPhysicalDevice));
+  VkPhysicalDevice *devices = push_array_no_zero(scratch.arena, VkPhysicalDevice, device_count);
   VK_CHECK(vkEnumeratePhysicalDevices(instance, &device_count, devices));
 
+  VkPhysicalDevice result      = 0;
+  U32              result_rank = 0;
+
   // Check for compatability
   for (U32 i = 0; i < device_count; ++i) {
     VkPhysicalDevice device = devices[i];
@@ -22,15 +47,15 @@ physical_device_find_compatible(VkInstance instance, const char **required_exten
     VkPhysicalDeviceProperties properties;
     vkGetPhysicalDeviceProperties(device, &properties);
 
-    // Only select discrete GPU's
-    if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+    U32 rank = physical_device_type_rank(properties.deviceType);
+    if (rank <= result_rank) {
       continue;
     }
 
     U32 device_extension_count;
     VK_CHECK(vkEnumerateDeviceExtensionProperties(device, 0, &device_extension_count, 0));
 
-    VkExtensionProperties *device_extensions = malloc(device_extension_count * sizeof(VkExtensionProperties));
+    VkExtensionProperties *device_extensions = push_array_no_zero(scratch.arena, VkExtensionProperties, device_extension_count);
     VK_CHECK(vkEnumerateDeviceExtensionProperties(device, 0, &device_extension_count, device_extensions));
 
     B8 compatible = 1;
@@ -55,15 +80,19 @@ physical_device_find_compatible(VkInstance instance, const char **required_exten
     }
 
     if (!compatible) {
-      free(device_extensions);
       continue;
     }
 
-    free(device_extensions);
-    free(devices);
-    return device;
+    result      = device;
+    result_rank = rank;
+  }
+
+  if (result) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(result, &properties);
+    log_dev("Physical device: %s", properties.deviceName);
   }
 
-  free(devices);
-  return 0;
+  scratch_end(scratch);
+  return result;
 }
@@ -1,10 +1,12 @@
 #include "nvulkan.h"
 
+#include "base/base_arena.h"
+
 // Keep this here so we know later where we have to use it
 static VkAllocationCallbacks *g_allocator = 0;
 
 Pipeline
-pipeline_create(Device *ldevice, DescriptorSet *desc_set, VkRenderPass render_pass, Shader *shaders, U32 shader_count,
+pipeline_create(Device *ldevice, DescriptorSet *desc_sets, U32 desc_set_count, VkRenderPass render_pass, Shader *shaders, U32 shader_count,
                 VkVertexInputBindingDescription *binding_descriptions, U32 binding_description_count,
                 VkVertexInputAttributeDescription *attribute_descriptions, U32 attribute_description_count, U32 cull_mode)
 {
@@ -30,13 +32,15 @@ pipeline_create(Device *ldevice, DescriptorSet *desc_set, VkRenderPass render_pa
     size_t size = ftell(f);
     fseek(f, 0, SEEK_SET);
 
-    char *code = malloc(size);
+    Temp scratch = scratch_begin(0, 0);
+
+    U32 *code = push_array_no_zero(scratch.arena, U32, (size + 3) / 4);
     fread(code, 1, size, f);
     fclose(f);
 
     VkShaderModuleCreateInfo module_info = {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
     module_info.codeSize                 = size;
-    module_info.pCode                    = (U32 *)code;
+    module_info.pCode                    = code;
 
     VkShaderModule module;
     VK_CHECK(vkCreateShaderModule(ldevice->handle, &module_info, g_allocator, &module));
@@ -47,7 +51,7 @@ pipeline_create(Device *ldevice, DescriptorSet *desc_set, VkRenderPass render_pa
     stage.pName                           = "main";
 
     p.shader_stages[i] = stage;
-    free(code);
+    scratch_end(scratch);
   }
 
   VkPipelineInputAssemblyStateCreateInfo input_assembly_state = {VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
@@ -98,9 +102,16 @@ pipeline_create(Device *ldevice, DescriptorSet *desc_set, VkRenderPass render_pa
   vertex_input_stage.vertexAttributeDescriptionCount      = attribute_description_count;
   vertex_input_stage.pVertexAttributeDescriptions         = attribute_descriptions;
 
+  // set i of the shaders is desc_sets[i]
+  VkDescriptorSetLayout set_layouts[4];
+  Assert(desc_set_count <= ArrayCount(set_layouts));
+  for (U32 i = 0; i < desc_set_count; ++i) {
+    set_layouts[i] = desc_sets[i].layout;
+  }
+
   VkPipelineLayoutCreateInfo layout_info = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-  layout_info.setLayoutCount             = 1;
-  layout_info.pSetLayouts                = &desc_set->layout;
+  layout_info.setLayoutCount             = desc_set_count;
+  layout_info.pSetLayouts                = set_layouts;
 
   VK_CHECK(vkCreatePipelineLayout(ldevice->handle, &layout_info, 0, &p.layout));
 
@@ -118,8 +129,7 @@ pipeline_create(Device *ldevice, DescriptorSet *desc_set, VkRenderPass render_pa
   pipeline_info.layout                       = p.layout;
   pipeline_info.renderPass                   = render_pass;
 
-  // @Todo: add pipeline cache
-  VK_CHECK(vkCreateGraphicsPipelines(ldevice->handle, VK_NULL_HANDLE, 1, &pipeline_info, g_allocator, &p.handle));
+  VK_CHECK(vkCreateGraphicsPipelines(ldevice->handle, ldevice->pipeline_cache, 1, &pipeline_info, g_allocator, &p.handle));
 
   return p;
 }
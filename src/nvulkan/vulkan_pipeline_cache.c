@@ -0,0 +1,115 @@
+#include "nvulkan.h"
+
+#include "base/base_os.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Keep this here so we know later where we have to use it
+static VkAllocationCallbacks *g_allocator = 0;
+
+// On disk: PipelineCacheHeader | data[data_size]
+// The driver rejects foreign data on its own, but we check first so a stale
+// or truncated file never reaches it.
+
+#define PIPELINE_CACHE_MAGIC   0x4c505043u // "CPPL"
+#define PIPELINE_CACHE_VERSION 1
+
+typedef struct PipelineCacheHeader PipelineCacheHeader;
+
+struct PipelineCacheHeader {
+  U32 magic;
+  U32 version;
+  U32 vendor_id;
+  U32 device_id;
+  U32 driver_version;
+  U8  uuid[VK_UUID_SIZE];
+  U64 data_size;
+  U64 data_hash;
+};
+
+static PipelineCacheHeader
+pipeline_cache_header_make(VkPhysicalDevice pdevice)
+{
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(pdevice, &props);
+
+  PipelineCacheHeader header = {0};
+  header.magic               = PIPELINE_CACHE_MAGIC;
+  header.version             = PIPELINE_CACHE_VERSION;
+  header.vendor_id           = props.vendorID;
+  header.device_id           = props.deviceID;
+  header.driver_version      = props.driverVersion;
+  MemoryCopy(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+
+  return header;
+}
+
+void
+pipeline_cache_create(Device *ldevice, VkPhysicalDevice pdevice, const char *path)
+{
+  PipelineCacheHeader expected = pipeline_cache_header_make(pdevice);
+
+  FileMap file = {0};
+  void   *data = 0;
+  U64     size = 0;
+
+  if (os_file_map(&file, path)) {
+    PipelineCacheHeader *header = (PipelineCacheHeader *)file.data;
+
+    B32 valid = file.size >= sizeof(PipelineCacheHeader);
+    valid     = valid && header->magic == expected.magic && header->version == expected.version;
+    valid     = valid && header->vendor_id == expected.vendor_id && header->device_id == expected.device_id;
+    valid     = valid && header->driver_version == expected.driver_version;
+    valid     = valid && memcmp(header->uuid, expected.uuid, VK_UUID_SIZE) == 0;
+    valid     = valid && header->data_size == file.size - sizeof(PipelineCacheHeader);
+    valid     = valid && header->data_hash == hash_fnv1a(header + 1, header->data_size);
+
+    if (valid) {
+      data = header + 1;
+      size = header->data_size;
+    } else {
+      log_dev("Discarding stale pipeline cache: %s", path);
+    }
+  }
+
+  VkPipelineCacheCreateInfo create_info = {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+  create_info.initialDataSize           = size;
+  create_info.pInitialData              = data;
+
+  VK_CHECK(vkCreatePipelineCache(ldevice->handle, &create_info, g_allocator, &ldevice->pipeline_cache));
+
+  os_file_unmap(&file);
+
+  log_dev("Pipeline cache: %llu bytes loaded", (unsigned long long)size);
+}
+
+void
+pipeline_cache_destroy(Device *ldevice, VkPhysicalDevice pdevice, const char *path)
+{
+  size_t size = 0;
+  VK_CHECK(vkGetPipelineCacheData(ldevice->handle, ldevice->pipeline_cache, &size, 0));
+
+  Temp scratch = scratch_begin(0, 0);
+
+  void *data = push_array(scratch.arena, U8, size);
+  VK_CHECK(vkGetPipelineCacheData(ldevice->handle, ldevice->pipeline_cache, &size, data));
+
+  PipelineCacheHeader header = pipeline_cache_header_make(pdevice);
+  header.data_size           = size;
+  header.data_hash           = hash_fnv1a(data, size);
+
+  FILE *f = fopen(path, "wb");
+  if (f) {
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(data, 1, size, f);
+    fclose(f);
+  } else {
+    log_dev("Failed to write pipeline cache: %s", path);
+  }
+
+  scratch_end(scratch);
+
+  vkDestroyPipelineCache(ldevice->handle, ldevice->pipeline_cache, g_allocator);
+  ldevice->pipeline_cache = VK_NULL_HANDLE;
+}
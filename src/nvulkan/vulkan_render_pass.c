@@ -33,14 +33,16 @@ render_pass_create_present(VkFormat color_format, VkFormat depth_format, Device
   depth_ref.attachment            = 1;
   depth_ref.layout                = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+  // the depth buffer is shared by all frames in flight, so the previous frame's depth writes have to finish first
   VkSubpassDependency subpass_dependency = {0};
   subpass_dependency.srcSubpass          = VK_SUBPASS_EXTERNAL;
   subpass_dependency.dstSubpass          = 0;
-  subpass_dependency.srcStageMask        = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-  subpass_dependency.dstStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  subpass_dependency.srcAccessMask       = VK_ACCESS_MEMORY_READ_BIT;
-  subpass_dependency.dstAccessMask       = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
-  subpass_dependency.dependencyFlags     = VK_DEPENDENCY_BY_REGION_BIT;
+  subpass_dependency.srcStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  subpass_dependency.dstStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  subpass_dependency.srcAccessMask       = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  subpass_dependency.dstAccessMask       = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+  subpass_dependency.dependencyFlags     = 0;
 
   VkSubpassDescription subpass_description    = {0};
   subpass_description.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -94,14 +96,24 @@ render_pass_create_offscreen(VkFormat color_format, VkFormat depth_format, Devic
   depth_ref.attachment            = 1;
   depth_ref.layout                = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-  VkSubpassDependency subpass_dependency = {0};
-  subpass_dependency.srcSubpass          = VK_SUBPASS_EXTERNAL;
-  subpass_dependency.dstSubpass          = 0;
-  subpass_dependency.srcStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  subpass_dependency.dstStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  subpass_dependency.srcAccessMask       = 0;
-  subpass_dependency.dstAccessMask       = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-  subpass_dependency.dependencyFlags     = 0;
+  // The color and depth images are shared by all frames in flight. Before writing them the previous frame has to be done
+  // sampling the color image in the postprocess pass and writing depth, afterwards the postprocess pass samples the color image.
+  VkSubpassDependency subpass_dependencies[2] = {0};
+  subpass_dependencies[0].srcSubpass          = VK_SUBPASS_EXTERNAL;
+  subpass_dependencies[0].dstSubpass          = 0;
+  subpass_dependencies[0].srcStageMask =
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  subpass_dependencies[0].dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  subpass_dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  subpass_dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+  subpass_dependencies[1].srcSubpass    = 0;
+  subpass_dependencies[1].dstSubpass    = VK_SUBPASS_EXTERNAL;
+  subpass_dependencies[1].srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  subpass_dependencies[1].dstStageMask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  subpass_dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  subpass_dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
   VkSubpassDescription subpass_description    = {0};
   subpass_description.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -114,8 +126,8 @@ render_pass_create_offscreen(VkFormat color_format, VkFormat depth_format, Devic
   render_pass_info.pAttachments           = attachments;
   render_pass_info.subpassCount           = 1;
   render_pass_info.pSubpasses             = &subpass_description;
-  render_pass_info.dependencyCount        = 1;
-  render_pass_info.pDependencies          = &subpass_dependency;
+  render_pass_info.dependencyCount        = ArrayCount(subpass_dependencies);
+  render_pass_info.pDependencies          = subpass_dependencies;
 
   VkRenderPass render_pass;
   VK_CHECK(vkCreateRenderPass(ldevice->handle, &render_pass_info, g_allocator, &render_pass));
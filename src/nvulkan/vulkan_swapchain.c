@@ -1,5 +1,7 @@
 #include "nvulkan.h"
 
+#include "base/base_arena.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -22,10 +24,12 @@ swapchain_create(U32 image_count, VkSurfaceKHR surface, VkPhysicalDevice pdevice
     swapchain.image_count = surface_capabilities.maxImageCount;
   }
 
+  Temp scratch = scratch_begin(0, 0);
+
   U32 format_count;
   vkGetPhysicalDeviceSurfaceFormatsKHR(pdevice, surface, &format_count, 0);
 
-  VkSurfaceFormatKHR *formats = malloc(format_count * sizeof(VkSurfaceFormatKHR));
+  VkSurfaceFormatKHR *formats = push_array_no_zero(scratch.arena, VkSurfaceFormatKHR, format_count);
   vkGetPhysicalDeviceSurfaceFormatsKHR(pdevice, surface, &format_count, formats);
 
   for (U32 i = 0; i < format_count; ++i) {
@@ -37,15 +41,7 @@ swapchain_create(U32 image_count, VkSurfaceKHR surface, VkPhysicalDevice pdevice
 
   swapchain_update(&swapchain, cmd_pool, 1);
 
-  // Create fences
-  swapchain.fences = malloc(swapchain.image_count * sizeof(VkFence));
-  for (U32 i = 0; i < swapchain.image_count; ++i) {
-    VkFenceCreateInfo create_info = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
-    create_info.flags             = VK_FENCE_CREATE_SIGNALED_BIT;
-    VK_CHECK(vkCreateFence(ldevice->handle, &create_info, g_allocator, &swapchain.fences[i]));
-  }
-
-  free(formats);
+  scratch_end(scratch);
   return swapchain;
 }
 
@@ -66,10 +62,12 @@ swapchain_update(Swapchain *sc, VkCommandPool cmd_pool, B8 vsync)
   sc->height        = extent.height;
 
   // Select present mode
+  Temp scratch = scratch_begin(0, 0);
+
   U32 present_mode_count;
   vkGetPhysicalDeviceSurfacePresentModesKHR(pdevice, surface, &present_mode_count, 0);
 
-  VkPresentModeKHR *present_modes = malloc(present_mode_count * sizeof(VkPresentModeKHR));
+  VkPresentModeKHR *present_modes = push_array_no_zero(scratch.arena, VkPresentModeKHR, present_mode_count);
   vkGetPhysicalDeviceSurfacePresentModesKHR(pdevice, surface, &present_mode_count, present_modes);
 
   VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
@@ -85,7 +83,7 @@ swapchain_update(Swapchain *sc, VkCommandPool cmd_pool, B8 vsync)
     }
   }
 
-  free(present_modes);
+  scratch_end(scratch);
 
   VkSurfaceTransformFlagBitsKHR transform;
   if (surface_capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) {
@@ -120,9 +118,8 @@ swapchain_update(Swapchain *sc, VkCommandPool cmd_pool, B8 vsync)
       vkDestroyImageView(ldevice->handle, sc->image_views[i], g_allocator);
     }
 
-    for (U32 i = 0; i < sc->image_count + 1; ++i) {
-      vkDestroySemaphore(ldevice->handle, sc->read_semaphores[i], g_allocator);
-      vkDestroySemaphore(ldevice->handle, sc->write_semaphores[i], g_allocator);
+    for (U32 i = 0; i < sc->image_count; ++i) {
+      vkDestroySemaphore(ldevice->handle, sc->render_finished[i], g_allocator);
     }
 
     vkDestroySwapchainKHR(ldevice->handle, old_swapchain, g_allocator);
@@ -168,16 +165,15 @@ swapchain_update(Swapchain *sc, VkCommandPool cmd_pool, B8 vsync)
     sc->barriers[i] = barrier;
   }
 
-  // Create semaphores
-  sc->semaphore_count  = sc->image_count + 1;
-  sc->read_semaphores  = realloc(sc->read_semaphores, sc->semaphore_count * sizeof(VkSemaphore));
-  sc->write_semaphores = realloc(sc->write_semaphores, sc->semaphore_count * sizeof(VkSemaphore));
+  // Create semaphores, the frames that used the old images are done (resize waits for the device)
+  sc->render_finished = realloc(sc->render_finished, sc->image_count * sizeof(VkSemaphore));
+  sc->image_fences    = realloc(sc->image_fences, sc->image_count * sizeof(VkFence));
 
-  for (U32 i = 0; i < sc->semaphore_count; ++i) {
+  for (U32 i = 0; i < sc->image_count; ++i) {
     VkSemaphoreCreateInfo create_info = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
 
-    VK_CHECK(vkCreateSemaphore(ldevice->handle, &create_info, g_allocator, &sc->read_semaphores[i]));
-    VK_CHECK(vkCreateSemaphore(ldevice->handle, &create_info, g_allocator, &sc->write_semaphores[i]));
+    VK_CHECK(vkCreateSemaphore(ldevice->handle, &create_info, g_allocator, &sc->render_finished[i]));
+    sc->image_fences[i] = VK_NULL_HANDLE;
   }
 
   VkCommandBuffer cmd_buf = command_buffer_allocate(ldevice, cmd_pool);
@@ -195,74 +191,66 @@ swapchain_destroy(Swapchain *sc)
 
   for (U32 i = 0; i < sc->image_count; ++i) {
     vkDestroyImageView(ldevice->handle, sc->image_views[i], g_allocator);
-    vkDestroyFence(ldevice->handle, sc->fences[i], g_allocator);
+    vkDestroySemaphore(ldevice->handle, sc->render_finished[i], g_allocator);
   }
   free(sc->images);
   free(sc->image_views);
-  free(sc->fences);
   free(sc->barriers);
-
-  for (U32 i = 0; i < sc->image_count + 1; ++i) {
-    vkDestroySemaphore(ldevice->handle, sc->read_semaphores[i], g_allocator);
-    vkDestroySemaphore(ldevice->handle, sc->write_semaphores[i], g_allocator);
-  }
-  free(sc->read_semaphores);
-  free(sc->write_semaphores);
+  free(sc->render_finished);
+  free(sc->image_fences);
 
   vkDestroySwapchainKHR(ldevice->handle, sc->handle, g_allocator);
 }
 
 U32
-swapchain_acquire(Swapchain *sc)
+swapchain_acquire(Swapchain *sc, Frame *frame)
 {
   // @Todo check for resize and destroy and recreate swapchain
   VkDevice ldevice = sc->ldevice->handle;
 
-  VkSemaphore sempahore = sc->read_semaphores[sc->current_semaphore];
-
-  VkResult result = vkAcquireNextImageKHR(ldevice, sc->handle, UINT64_MAX, sempahore, 0, &sc->current_image);
+  VkResult result = vkAcquireNextImageKHR(ldevice, sc->handle, UINT64_MAX, frame->image_available, 0, &sc->current_image);
 
   if (result != VK_SUCCESS) {
     // @Todo handle resize
   }
 
-  do {
-    result = vkWaitForFences(ldevice, 1, &sc->fences[sc->current_image], VK_TRUE, UINT64_MAX);
-  } while (result != VK_SUCCESS);
+  // with more frames in flight than free images, the image can still be in use by an older frame
+  VkFence image_fence = sc->image_fences[sc->current_image];
+  if (image_fence != VK_NULL_HANDLE && image_fence != frame->fence) {
+    VK_CHECK(vkWaitForFences(ldevice, 1, &image_fence, VK_TRUE, UINT64_MAX));
+  }
+  sc->image_fences[sc->current_image] = frame->fence;
 
   return sc->current_image;
 }
 
 void
-swapchain_present(Swapchain *sc, CommandBuffers *cmd_bufs)
+swapchain_present(Swapchain *sc, Frame *frame)
 {
   Device *ldevice       = sc->ldevice;
   U32     current_image = sc->current_image;
 
-  // @Todo move this
-  vkResetFences(ldevice->handle, 1, &sc->fences[current_image]);
+  VK_CHECK(vkResetFences(ldevice->handle, 1, &frame->fence));
 
   VkPipelineStageFlags wait_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
   VkSubmitInfo         submitInfo      = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
   submitInfo.pWaitDstStageMask         = &wait_stage_mask;
-  submitInfo.pWaitSemaphores           = &sc->read_semaphores[sc->current_semaphore];
+  submitInfo.pWaitSemaphores           = &frame->image_available;
   submitInfo.waitSemaphoreCount        = 1;
-  submitInfo.pSignalSemaphores         = &sc->write_semaphores[sc->current_semaphore];
+  submitInfo.pSignalSemaphores         = &sc->render_finished[current_image];
   submitInfo.signalSemaphoreCount      = 1;
-  submitInfo.pCommandBuffers           = &cmd_bufs->handles[current_image];
+  submitInfo.pCommandBuffers           = &frame->cmd_buf;
   submitInfo.commandBufferCount        = 1;
   submitInfo.pNext                     = 0;
 
-  vkQueueSubmit(ldevice->graphics_queue, 1, &submitInfo, sc->fences[current_image]);
+  VK_CHECK(vkQueueSubmit(ldevice->graphics_queue, 1, &submitInfo, frame->fence));
 
   VkPresentInfoKHR present_info   = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
   present_info.swapchainCount     = 1;
   present_info.pSwapchains        = &sc->handle;
   present_info.waitSemaphoreCount = 1;
-  present_info.pWaitSemaphores    = &sc->write_semaphores[sc->current_semaphore];
+  present_info.pWaitSemaphores    = &sc->render_finished[current_image];
   present_info.pImageIndices      = &sc->current_image;
 
   vkQueuePresentKHR(ldevice->graphics_queue, &present_info);
-
-  sc->current_semaphore = (sc->current_semaphore + 1) % sc->semaphore_count;
 }
@@ -0,0 +1,466 @@
+#include "nvulkan.h"
+
+#include <string.h>
+
+// Keep this here so we know later where we have to use it
+static VkAllocationCallbacks *g_allocator = 0;
+
+#define UPLOADER_ALIGNMENT 16
+
+// everything that reads uploaded data on the graphics queue
+#define UPLOADER_READ_STAGES                                                                                                               \
+  (VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |                      \
+   VK_PIPELINE_STAGE_TRANSFER_BIT)
+#define UPLOADER_READ_ACCESS                                                                                                               \
+  (VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT |                \
+   VK_ACCESS_TRANSFER_READ_BIT)
+
+Uploader
+uploader_create(Device *ldevice, VkDeviceSize ring_size)
+{
+  Uploader up  = {0};
+  up.ldevice   = ldevice;
+  up.ring_size = ring_size;
+  up.ring      = buffer_create_staging(ring_size, 0, 0, ldevice);
+  up.separate  = ldevice->transfer_queue_index != ldevice->graphics_queue_index;
+
+  up.cmd_pool = command_pool_create(ldevice, ldevice->transfer_queue_index);
+  up.cmd_buf  = command_buffer_allocate(ldevice, up.cmd_pool);
+
+  if (up.separate) {
+    up.acquire_cmd_pool = command_pool_create(ldevice, ldevice->graphics_queue_index);
+    up.acquire_cmd_buf  = command_buffer_allocate(ldevice, up.acquire_cmd_pool);
+
+    VkSemaphoreCreateInfo semaphore_info = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    VK_CHECK(vkCreateSemaphore(ldevice->handle, &semaphore_info, g_allocator, &up.semaphore));
+  }
+
+  VkFenceCreateInfo fence_info = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+  VK_CHECK(vkCreateFence(ldevice->handle, &fence_info, g_allocator, &up.fence));
+
+  return up;
+}
+
+void
+uploader_destroy(Uploader *up)
+{
+  uploader_flush(up);
+  uploader_wait(up);
+
+  free(up->overflow);
+  free(up->buffer_barriers);
+  free(up->image_barriers);
+  free(up->mips);
+
+  if (up->separate) {
+    vkDestroySemaphore(up->ldevice->handle, up->semaphore, g_allocator);
+    command_buffer_free(up->acquire_cmd_buf, up->ldevice, up->acquire_cmd_pool);
+    command_pool_destroy(up->acquire_cmd_pool, up->ldevice);
+  }
+
+  vkDestroyFence(up->ldevice->handle, up->fence, g_allocator);
+  command_buffer_free(up->cmd_buf, up->ldevice, up->cmd_pool);
+  command_pool_destroy(up->cmd_pool, up->ldevice);
+  buffer_destroy(&up->ring, up->ldevice);
+}
+
+static void
+uploader_begin(Uploader *up)
+{
+  // the command buffers and the ring can only be reused once the previous batch is done
+  if (up->in_flight) {
+    uploader_wait(up);
+  }
+
+  if (!up->recording) {
+    VK_CHECK(vkResetCommandBuffer(up->cmd_buf, 0));
+    command_buffer_begin(up->cmd_buf);
+    up->recording = 1;
+  }
+}
+
+// reserves staging memory for the current batch and returns where to write it
+static U8 *
+uploader_stage(Uploader *up, VkDeviceSize size, Buffer **out_buffer, VkDeviceSize *out_offset)
+{
+  uploader_begin(up);
+
+  if (size > up->ring_size) {
+    if (up->overflow_count == up->overflow_capacity) {
+      up->overflow_capacity = up->overflow_capacity ? up->overflow_capacity * 2 : 4;
+      up->overflow          = realloc(up->overflow, up->overflow_capacity * sizeof(Buffer));
+    }
+
+    Buffer *staging = &up->overflow[up->overflow_count++];
+    *staging        = buffer_create_staging(size, 0, 0, up->ldevice);
+
+    up->overflow_size += size;
+    up->copy_count++;
+
+    *out_buffer = staging;
+    *out_offset = 0;
+    return (U8 *)buffer_map(staging);
+  }
+
+  // Not a real ring: space is only reused once the whole batch is done, so a full ring submits the batch
+  // and the next stage waits for all of it before starting over at 0
+  VkDeviceSize offset = AlignPow2(up->ring_head, UPLOADER_ALIGNMENT);
+  if (offset + size > up->ring_size) {
+    uploader_flush(up);
+    uploader_begin(up);
+    offset = 0;
+  }
+
+  up->ring_head = offset + size;
+  up->copy_count++;
+
+  *out_buffer = &up->ring;
+  *out_offset = offset;
+  return (U8 *)buffer_map(&up->ring) + offset;
+}
+
+static void
+uploader_push_buffer_barrier(Uploader *up, Buffer *dst, VkDeviceSize offset, VkDeviceSize size)
+{
+  if (up->buffer_barrier_count == up->buffer_barrier_capacity) {
+    up->buffer_barrier_capacity = up->buffer_barrier_capacity ? up->buffer_barrier_capacity * 2 : 16;
+    up->buffer_barriers         = realloc(up->buffer_barriers, up->buffer_barrier_capacity * sizeof(VkBufferMemoryBarrier));
+  }
+
+  VkBufferMemoryBarrier barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+  barrier.srcQueueFamilyIndex   = up->ldevice->transfer_queue_index;
+  barrier.dstQueueFamilyIndex   = up->ldevice->graphics_queue_index;
+  barrier.buffer                = dst->handle;
+  barrier.offset                = offset;
+  barrier.size                  = size;
+
+  up->buffer_barriers[up->buffer_barrier_count++] = barrier;
+}
+
+static void
+uploader_push_image_barrier(Uploader *up, Image *dst, VkImageLayout old_layout, VkImageLayout new_layout)
+{
+  if (up->image_barrier_count == up->image_barrier_capacity) {
+    up->image_barrier_capacity = up->image_barrier_capacity ? up->image_barrier_capacity * 2 : 16;
+    up->image_barriers         = realloc(up->image_barriers, up->image_barrier_capacity * sizeof(VkImageMemoryBarrier));
+  }
+
+  VkImageSubresourceRange subresource_range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+
+  VkImageMemoryBarrier barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  barrier.oldLayout            = old_layout;
+  barrier.newLayout            = new_layout;
+  barrier.srcQueueFamilyIndex  = up->separate ? up->ldevice->transfer_queue_index : VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex  = up->separate ? up->ldevice->graphics_queue_index : VK_QUEUE_FAMILY_IGNORED;
+  barrier.image                = dst->handle;
+  barrier.subresourceRange     = subresource_range;
+
+  up->image_barriers[up->image_barrier_count++] = barrier;
+}
+
+// Blits every level from the one above it with a linear filter. Level 0 has to be in TRANSFER_DST with its copy
+// recorded before, afterwards all levels are in TRANSFER_SRC.
+static void
+uploader_record_mips(VkCommandBuffer cmd_buf, UploaderMips *mips)
+{
+  VkImageMemoryBarrier barrier        = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  barrier.oldLayout                   = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout                   = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image                       = mips->image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.srcAccessMask               = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask               = VK_ACCESS_TRANSFER_READ_BIT;
+
+  S32 width  = (S32)mips->width;
+  S32 height = (S32)mips->height;
+
+  for (U32 level = 1; level < mips->mip_levels; ++level) {
+    // the level above is complete, make it the blit source
+    barrier.subresourceRange.baseMipLevel = level - 1;
+    vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &barrier);
+
+    S32 next_width  = width > 1 ? width / 2 : 1;
+    S32 next_height = height > 1 ? height / 2 : 1;
+
+    VkImageBlit blit               = {0};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel   = level - 1;
+    blit.srcSubresource.layerCount = 1;
+    blit.srcOffsets[1].x           = width;
+    blit.srcOffsets[1].y           = height;
+    blit.srcOffsets[1].z           = 1;
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel   = level;
+    blit.dstSubresource.layerCount = 1;
+    blit.dstOffsets[1].x           = next_width;
+    blit.dstOffsets[1].y           = next_height;
+    blit.dstOffsets[1].z           = 1;
+
+    vkCmdBlitImage(cmd_buf, mips->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mips->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    width  = next_width;
+    height = next_height;
+  }
+
+  // the last level was only written, so the whole chain ends up in one layout
+  barrier.subresourceRange.baseMipLevel = mips->mip_levels - 1;
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &barrier);
+}
+
+// Returns the staging memory to write the data to. It has to be filled before the next stage, staging can flush the
+// batch when the ring is full and the copy is submitted with it.
+void *
+uploader_stage_buffer(Uploader *up, Buffer *dst, VkDeviceSize dst_offset, VkDeviceSize size)
+{
+  Buffer      *staging;
+  VkDeviceSize staging_offset;
+  U8          *mapped = uploader_stage(up, size, &staging, &staging_offset);
+
+  buffer_copy(up->cmd_buf, dst, dst_offset, staging, staging_offset, size);
+
+  // on a single queue one memory barrier at the end of the batch covers all buffers
+  if (up->separate) {
+    uploader_push_buffer_barrier(up, dst, dst_offset, size);
+  }
+
+  return mapped;
+}
+
+void
+uploader_upload_buffer(Uploader *up, Buffer *dst, VkDeviceSize dst_offset, void *data, VkDeviceSize size)
+{
+  MemoryCopy(uploader_stage_buffer(up, dst, dst_offset, size), data, size);
+}
+
+// stages the data and moves every level of dst to TRANSFER_DST, the copies are recorded by the caller
+static Buffer *
+uploader_stage_image(Uploader *up, Image *dst, void *data, VkDeviceSize size, VkDeviceSize *staging_offset)
+{
+  Buffer *staging;
+  U8     *mapped = uploader_stage(up, size, &staging, staging_offset);
+
+  MemoryCopy(mapped, data, size);
+
+  VkImageSubresourceRange subresource_range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+
+  VkImageMemoryBarrier barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  barrier.oldLayout            = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout            = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image                = dst->handle;
+  barrier.subresourceRange     = subresource_range;
+  barrier.srcAccessMask        = 0;
+  barrier.dstAccessMask        = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  vkCmdPipelineBarrier(up->cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &barrier);
+
+  return staging;
+}
+
+void
+uploader_upload_image(Uploader *up, Image *dst, U32 width, U32 height, void *data, VkDeviceSize size)
+{
+  VkDeviceSize staging_offset;
+  Buffer      *staging = uploader_stage_image(up, dst, data, size, &staging_offset);
+
+  VkBufferImageCopy region           = {0};
+  region.bufferOffset                = staging_offset;
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent.width           = width;
+  region.imageExtent.height          = height;
+  region.imageExtent.depth           = 1;
+
+  vkCmdCopyBufferToImage(up->cmd_buf, staging->handle, dst->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+  // the transition to SHADER_READ_ONLY (and the ownership transfer) is recorded with the rest of the batch
+  if (dst->mip_levels <= 1) {
+    uploader_push_image_barrier(up, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    return;
+  }
+
+  UploaderMips mips = {dst->handle, width, height, dst->mip_levels};
+
+  if (!up->separate) {
+    uploader_record_mips(up->cmd_buf, &mips);
+    uploader_push_image_barrier(up, dst, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    return;
+  }
+
+  // only ownership moves here, the graphics queue blits the chain and transitions it after the acquire
+  if (up->mip_count == up->mip_capacity) {
+    up->mip_capacity = up->mip_capacity ? up->mip_capacity * 2 : 16;
+    up->mips         = realloc(up->mips, up->mip_capacity * sizeof(UploaderMips));
+  }
+
+  up->mips[up->mip_count++] = mips;
+  uploader_push_image_barrier(up, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+}
+
+// Uploads an image together with its precomputed mips in one staging copy. level_offsets has an entry per mip level
+// of dst and says where the level starts in data, rows are tightly packed (for block formats, rows of blocks).
+void
+uploader_upload_image_levels(Uploader *up, Image *dst, U32 width, U32 height, void *data, VkDeviceSize size, VkDeviceSize *level_offsets)
+{
+  VkDeviceSize staging_offset;
+  Buffer      *staging = uploader_stage_image(up, dst, data, size, &staging_offset);
+
+  VkBufferImageCopy regions[32];
+  U32               region_count = Min(dst->mip_levels, ArrayCount(regions));
+
+  for (U32 level = 0; level < region_count; ++level) {
+    Assert(level_offsets[level] < size);
+
+    VkBufferImageCopy region           = {0};
+    region.bufferOffset                = staging_offset + level_offsets[level];
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel   = level;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width           = Max(width >> level, 1);
+    region.imageExtent.height          = Max(height >> level, 1);
+    region.imageExtent.depth           = 1;
+
+    regions[level] = region;
+  }
+
+  vkCmdCopyBufferToImage(up->cmd_buf, staging->handle, dst->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, region_count, regions);
+
+  // every level is filled, so only the final transition is left
+  uploader_push_image_barrier(up, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+static void
+uploader_set_barrier_access(Uploader *up, VkAccessFlags src_access, VkAccessFlags dst_access)
+{
+  for (U32 i = 0; i < up->buffer_barrier_count; ++i) {
+    up->buffer_barriers[i].srcAccessMask = src_access;
+    up->buffer_barriers[i].dstAccessMask = dst_access;
+  }
+
+  for (U32 i = 0; i < up->image_barrier_count; ++i) {
+    up->image_barriers[i].srcAccessMask = src_access;
+    up->image_barriers[i].dstAccessMask = dst_access;
+  }
+}
+
+void
+uploader_flush(Uploader *up)
+{
+  if (!up->recording) {
+    return;
+  }
+
+  if (up->separate) {
+    // Release on the transfer queue, the graphics queue acquires the same ranges after waiting on the semaphore.
+    // Transfer only queues don't know about shader stages, so the release ends at BOTTOM_OF_PIPE.
+    uploader_set_barrier_access(up, VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+    vkCmdPipelineBarrier(up->cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, 0,
+                         up->buffer_barrier_count, up->buffer_barriers, up->image_barrier_count, up->image_barriers);
+    command_buffer_end(up->cmd_buf);
+
+    VkSubmitInfo submit         = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit.commandBufferCount   = 1;
+    submit.pCommandBuffers      = &up->cmd_buf;
+    submit.signalSemaphoreCount = 1;
+    submit.pSignalSemaphores    = &up->semaphore;
+
+    VK_CHECK(vkQueueSubmit(up->ldevice->transfer_queue, 1, &submit, VK_NULL_HANDLE));
+
+    VK_CHECK(vkResetCommandBuffer(up->acquire_cmd_buf, 0));
+    command_buffer_begin(up->acquire_cmd_buf);
+
+    uploader_set_barrier_access(up, 0, UPLOADER_READ_ACCESS);
+    for (U32 i = 0; i < up->image_barrier_count; ++i) {
+      if (up->image_barriers[i].newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+        up->image_barriers[i].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+      }
+    }
+
+    vkCmdPipelineBarrier(up->acquire_cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, UPLOADER_READ_STAGES, 0, 0, 0, up->buffer_barrier_count,
+                         up->buffer_barriers, up->image_barrier_count, up->image_barriers);
+
+    for (U32 i = 0; i < up->mip_count; ++i) {
+      uploader_record_mips(up->acquire_cmd_buf, &up->mips[i]);
+
+      VkImageSubresourceRange subresource_range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+
+      VkImageMemoryBarrier barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+      barrier.oldLayout            = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+      barrier.newLayout            = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      barrier.srcQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+      barrier.image                = up->mips[i].image;
+      barrier.subresourceRange     = subresource_range;
+      barrier.srcAccessMask        = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask        = VK_ACCESS_SHADER_READ_BIT;
+
+      vkCmdPipelineBarrier(up->acquire_cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, UPLOADER_READ_STAGES, 0, 0, 0, 0, 0, 1, &barrier);
+    }
+
+    command_buffer_end(up->acquire_cmd_buf);
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkSubmitInfo acquire_submit       = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    acquire_submit.waitSemaphoreCount = 1;
+    acquire_submit.pWaitSemaphores    = &up->semaphore;
+    acquire_submit.pWaitDstStageMask  = &wait_stage;
+    acquire_submit.commandBufferCount = 1;
+    acquire_submit.pCommandBuffers    = &up->acquire_cmd_buf;
+
+    // the fence is on the acquire so it covers both submits
+    VK_CHECK(vkQueueSubmit(up->ldevice->graphics_queue, 1, &acquire_submit, up->fence));
+  } else {
+    // one barrier for all buffer copies of the batch, anything recorded after this submit sees the data
+    VkMemoryBarrier barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = UPLOADER_READ_ACCESS;
+
+    uploader_set_barrier_access(up, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(up->cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, UPLOADER_READ_STAGES, 0, 1, &barrier, 0, 0, up->image_barrier_count,
+                         up->image_barriers);
+    command_buffer_end(up->cmd_buf);
+
+    VkSubmitInfo submit       = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers    = &up->cmd_buf;
+
+    VK_CHECK(vkQueueSubmit(up->ldevice->graphics_queue, 1, &submit, up->fence));
+  }
+
+  log_dev("Uploader: submitted %u copies (%.2f MB staged) on the %s queue", up->copy_count,
+          (F64)(up->ring_head + up->overflow_size) / MB(1), up->separate ? "transfer" : "graphics");
+
+  up->recording            = 0;
+  up->in_flight            = 1;
+  up->copy_count           = 0;
+  up->buffer_barrier_count = 0;
+  up->image_barrier_count  = 0;
+  up->mip_count            = 0;
+}
+
+void
+uploader_wait(Uploader *up)
+{
+  if (!up->in_flight) {
+    return;
+  }
+
+  VK_CHECK(vkWaitForFences(up->ldevice->handle, 1, &up->fence, VK_TRUE, UINT64_MAX));
+  VK_CHECK(vkResetFences(up->ldevice->handle, 1, &up->fence));
+
+  for (U32 i = 0; i < up->overflow_count; ++i) {
+    buffer_destroy(&up->overflow[i], up->ldevice);
+  }
+
+  up->overflow_count = 0;
+  up->overflow_size  = 0;
+  up->ring_head      = 0;
+  up->in_flight      = 0;
+}